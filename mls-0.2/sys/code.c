@@ -11,6 +11,7 @@
 #include "machine.h"
 #include "objects.h"
 #include "memory.h"
+#include "largeint.h"
 #include "tree.h"
 #include "code.h"
 #include "ui.h"
@@ -85,6 +86,13 @@ static void patchOperand2(int where, int value) {
 }
 
 
+static void setStacksize(int stacksize) {
+  /* used where control flow merges or continues elsewhere */
+  currentStacksize = 0;
+  updateStack(stacksize);
+}
+
+
 /**************************************************************/
 
 
@@ -220,24 +228,102 @@ static void codeCascade(Node *node, Bool valueNeeded) {
 }
 
 
-static void codeMessage(Node *node, Bool valueNeeded) {
-  List *arguments;
+/*
+ * Messages which implement control structures are coded in line
+ * if their receiver and argument blocks are literal blocks without
+ * arguments. The receiver of a conditional is tested by JUMPTRUE or
+ * JUMPFALSE, which pop a boolean and either jump or skip the next
+ * instruction. For any other object, they leave it on the stack and
+ * continue with the next instruction, a JUMP to code which sends the
+ * message as usual, with real blocks as arguments. These blocks are
+ * coded without further inlining, which bounds the size of the code.
+ * The condition of a loop must be a boolean, otherwise the message
+ * mustBeBoolean is sent to it and the loop is left.
+ */
 
-  /* ATTENTION: if we have a null receiver (a cascaded message)
-     then do nothing since the receiver has already been pushed */
-  if (node->u.messageNode.receiver != NULL) {
-    codeNode(node->u.messageNode.receiver, true);
+
+static Bool inlineEnabled = true;
+
+
+static Bool isInlineBlock(Node *node) {
+  return node->type == Block && node->u.blockNode.numArgs == 0;
+}
+
+
+static void codeInlineBlock(Node *node, Bool valueNeeded) {
+  List *statements;
+  Node *statement;
+
+  statements = node->u.blockNode.statements;
+  if (statements == NULL) {
+    if (valueNeeded) {
+      codeInstr(OP_PUSHNIL, 0, 0, 1);
+    }
+    return;
   }
-  arguments = node->u.messageNode.arguments;
-  while (arguments != NULL) {
-    codeNode(arguments->head, true);
-    arguments = arguments->tail;
+  while (statements->tail != NULL) {
+    statement = statements->head;
+    codeNode(statement, false);
+    statements = statements->tail;
+  }
+  statement = statements->head;
+  if (statement->type == Return) {
+    codeNode(statement, false);
+    if (valueNeeded) {
+      /* not reached, but the stack must match the other paths */
+      updateStack(1);
+    }
+  } else {
+    codeNode(statement, valueNeeded);
+  }
+}
+
+
+static void codeBranch(Node *block, Byte constOpcode, Bool valueNeeded) {
+  if (block != NULL) {
+    codeInlineBlock(block, valueNeeded);
+  } else {
+    if (valueNeeded) {
+      codeInstr(constOpcode, 0, 0, 1);
+    }
+  }
+}
+
+
+/* in the order of the SPECIAL_xxx numbers in machine.h */
+static char *specialSelectors[NUM_SPECIALS] = {
+  "+", "-", "*", "//", "\\\\", "<", "<=", ">", ">=",
+  "=", "==", "~~", "bitAnd:", "bitOr:",
+};
+
+
+static int getSpecial(char *selector) {
+  int special;
+
+  for (special = 0; special < NUM_SPECIALS; special++) {
+    if (strcmp(selector, specialSelectors[special]) == 0) {
+      return special;
+    }
   }
+  return -1;
+}
+
+
+static void codeSend(Node *node, Bool valueNeeded) {
+  int special;
+
+  special = getSpecial(node->u.messageNode.selector);
   if (node->u.messageNode.superFlag) {
     codeInstr(OP_SENDSUPER,
               node->u.messageNode.numArgs,
               makeLiteral(node),
               -node->u.messageNode.numArgs);
+  } else
+  if (special >= 0) {
+    codeInstr(OP_SENDSPECIAL,
+              special,
+              makeLiteral(node),
+              -1);
   } else {
     codeInstr(OP_SEND,
               node->u.messageNode.numArgs,
@@ -250,6 +336,315 @@ static void codeMessage(Node *node, Bool valueNeeded) {
 }
 
 
+static void codeFallbackSend(Node *node, Bool valueNeeded) {
+  List *arguments;
+  Bool saveInlineEnabled;
+
+  saveInlineEnabled = inlineEnabled;
+  inlineEnabled = false;
+  arguments = node->u.messageNode.arguments;
+  while (arguments != NULL) {
+    codeNode(arguments->head, true);
+    arguments = arguments->tail;
+  }
+  inlineEnabled = saveInlineEnabled;
+  codeSend(node, valueNeeded);
+}
+
+
+static void codeConditional(Node *node, Bool valueNeeded,
+                            Byte jumpOpcode,
+                            Node *fallBlock, Byte fallOpcode,
+                            Node *jumpBlock, Byte jumpConstOpcode) {
+  int stacksize;
+  int condJump, sendJump, fallEndJump, sendEndJump;
+
+  /* receiver, then test it */
+  codeNode(node->u.messageNode.receiver, true);
+  stacksize = currentStacksize - 1;
+  condJump = getCurrentLocation();
+  codeInstr(jumpOpcode, 0, 0, -1);
+  sendJump = getCurrentLocation();
+  codeInstr(OP_JUMP, 0, 0, 0);
+  /* the branch for which the test does not jump */
+  codeBranch(fallBlock, fallOpcode, valueNeeded);
+  fallEndJump = getCurrentLocation();
+  codeInstr(OP_JUMP, 0, 0, 0);
+  /* the receiver is not a boolean: send the message */
+  patchOperand2(sendJump, getCurrentLocation());
+  setStacksize(stacksize + 1);
+  codeFallbackSend(node, valueNeeded);
+  sendEndJump = getCurrentLocation();
+  codeInstr(OP_JUMP, 0, 0, 0);
+  /* the branch to which the test jumps */
+  patchOperand2(condJump, getCurrentLocation());
+  setStacksize(stacksize);
+  codeBranch(jumpBlock, jumpConstOpcode, valueNeeded);
+  patchOperand2(fallEndJump, getCurrentLocation());
+  patchOperand2(sendEndJump, getCurrentLocation());
+}
+
+
+static void codeLoop(Node *node, Bool valueNeeded,
+                     Byte exitOpcode, Node *body) {
+  static Node *mustBeBoolean = NULL;
+  int stacksize;
+  int loopStart, exitJump, sendJump;
+
+  if (mustBeBoolean == NULL) {
+    mustBeBoolean = mkMessage(0, "mustBeBoolean", NULL, NULL);
+  }
+  /* condition, then test it */
+  stacksize = currentStacksize;
+  loopStart = getCurrentLocation();
+  codeInlineBlock(node->u.messageNode.receiver, true);
+  exitJump = getCurrentLocation();
+  codeInstr(exitOpcode, 0, 0, -1);
+  sendJump = getCurrentLocation();
+  codeInstr(OP_JUMP, 0, 0, 0);
+  /* the body, then repeat */
+  if (body != NULL) {
+    codeInlineBlock(body, false);
+  }
+  codeInstr(OP_JUMP, 0, loopStart, 0);
+  /* the condition is not a boolean: complain and leave */
+  patchOperand2(sendJump, getCurrentLocation());
+  setStacksize(stacksize + 1);
+  codeInstr(OP_SEND, 0, makeLiteral(mustBeBoolean), 0);
+  codeInstr(OP_DROP, 0, 0, -1);
+  /* the loop answers nil */
+  patchOperand2(exitJump, getCurrentLocation());
+  if (valueNeeded) {
+    codeInstr(OP_PUSHNIL, 0, 0, 1);
+  }
+}
+
+
+/*
+ * The counted loops to:do:, to:by:do: and timesRepeat: are coded
+ * in line if their body is a literal block. The counter, the limit
+ * and the step are kept in hidden temporaries following those of
+ * the method; each loop gets its own, because blocks share the
+ * temporaries of their method. FORPREP checks that the bounds are
+ * small integers, for which the counter cannot overflow, and jumps
+ * to the loop. Otherwise the message is sent with a real block.
+ * timesRepeat: counts the receiver down to 1. Like the methods
+ * which they replace, the loops answer their receiver.
+ */
+
+
+#define MAX_TEMPS		256
+
+static int firstHiddenTemp;
+static int numHiddenTemps;
+
+
+static Bool isLoopBlock(Node *node, int numArgs) {
+  return node->type == Block && node->u.blockNode.numArgs == numArgs;
+}
+
+
+static void codeCountedLoop(Node *node, Bool valueNeeded,
+                            Node *limit, Node *step, Node *body) {
+  static Node *one = NULL;
+  static Node *minusOne = NULL;
+  int counter;
+  int stacksize;
+  int prepJump, endJump, testJump, bodyStart;
+  Bool saveInlineEnabled;
+
+  if (one == NULL) {
+    one = mkInt(0, 1, NULL);
+    minusOne = mkInt(0, -1, NULL);
+  }
+  counter = firstHiddenTemp + numHiddenTemps;
+  numHiddenTemps += 3;
+  /* step into its temporary, receiver and limit onto the stack */
+  if (step == NULL) {
+    codeNode(limit == NULL ? minusOne : one, true);
+    codeInstr(OP_STORETEMP, counter + 2, 0, -1);
+  }
+  codeNode(node->u.messageNode.receiver, true);
+  codeNode(limit == NULL ? one : limit, true);
+  if (step != NULL) {
+    codeNode(step, true);
+    codeInstr(OP_STORETEMP, counter + 2, 0, -1);
+  }
+  stacksize = currentStacksize - 1;
+  prepJump = getCurrentLocation();
+  codeInstr(OP_FORPREP, counter, 0, 0);
+  /* the bounds are not small integers: send the message */
+  if (limit == NULL) {
+    codeInstr(OP_DROP, 0, 0, -1);
+  }
+  if (step != NULL) {
+    codeInstr(OP_PUSHTEMP, counter + 2, 0, 1);
+  }
+  saveInlineEnabled = inlineEnabled;
+  inlineEnabled = false;
+  codeNode(body, true);
+  inlineEnabled = saveInlineEnabled;
+  codeSend(node, valueNeeded);
+  endJump = getCurrentLocation();
+  codeInstr(OP_JUMP, 0, 0, 0);
+  /* the loop, with the receiver left on the stack */
+  patchOperand2(prepJump, getCurrentLocation());
+  setStacksize(stacksize);
+  testJump = getCurrentLocation();
+  codeInstr(OP_FORTEST, counter, 0, 0);
+  bodyStart = getCurrentLocation();
+  if (body->u.blockNode.numArgs != 0) {
+    codeInstr(OP_PUSHTEMP, counter, 0, 1);
+    codeStore(body->u.blockNode.arguments->head);
+  }
+  codeInlineBlock(body, false);
+  codeInstr(OP_FORSTEP, counter, bodyStart, 0);
+  patchOperand2(testJump, getCurrentLocation());
+  if (!valueNeeded) {
+    codeInstr(OP_DROP, 0, 0, -1);
+  }
+  patchOperand2(endJump, getCurrentLocation());
+}
+
+
+static Bool codeCounted(Node *node, Bool valueNeeded) {
+  char *selector;
+  List *arguments;
+
+  if (firstHiddenTemp + numHiddenTemps + 3 > MAX_TEMPS) {
+    return false;
+  }
+  selector = node->u.messageNode.selector;
+  arguments = node->u.messageNode.arguments;
+  if (strcmp(selector, "to:do:") == 0 &&
+      isLoopBlock(arguments->tail->head, 1)) {
+    codeCountedLoop(node, valueNeeded,
+                    arguments->head, NULL,
+                    arguments->tail->head);
+    return true;
+  }
+  if (strcmp(selector, "to:by:do:") == 0 &&
+      isLoopBlock(arguments->tail->tail->head, 1)) {
+    codeCountedLoop(node, valueNeeded,
+                    arguments->head, arguments->tail->head,
+                    arguments->tail->tail->head);
+    return true;
+  }
+  if (strcmp(selector, "timesRepeat:") == 0 &&
+      isLoopBlock(arguments->head, 0)) {
+    codeCountedLoop(node, valueNeeded,
+                    NULL, NULL,
+                    arguments->head);
+    return true;
+  }
+  return false;
+}
+
+
+static Bool codeControl(Node *node, Bool valueNeeded) {
+  char *selector;
+  Node *receiver;
+  Node *arg1, *arg2;
+
+  receiver = node->u.messageNode.receiver;
+  if (!inlineEnabled ||
+      receiver == NULL ||
+      node->u.messageNode.superFlag) {
+    return false;
+  }
+  if (codeCounted(node, valueNeeded)) {
+    return true;
+  }
+  selector = node->u.messageNode.selector;
+  arg1 = NULL;
+  arg2 = NULL;
+  if (node->u.messageNode.arguments != NULL) {
+    arg1 = node->u.messageNode.arguments->head;
+    if (!isInlineBlock(arg1)) {
+      return false;
+    }
+    if (node->u.messageNode.arguments->tail != NULL) {
+      arg2 = node->u.messageNode.arguments->tail->head;
+      if (!isInlineBlock(arg2)) {
+        return false;
+      }
+    }
+  }
+  if (strcmp(selector, "ifTrue:") == 0) {
+    codeConditional(node, valueNeeded,
+                    OP_JUMPFALSE, arg1, 0, NULL, OP_PUSHNIL);
+    return true;
+  }
+  if (strcmp(selector, "ifFalse:") == 0) {
+    codeConditional(node, valueNeeded,
+                    OP_JUMPTRUE, arg1, 0, NULL, OP_PUSHNIL);
+    return true;
+  }
+  if (strcmp(selector, "ifTrue:ifFalse:") == 0) {
+    codeConditional(node, valueNeeded,
+                    OP_JUMPFALSE, arg1, 0, arg2, 0);
+    return true;
+  }
+  if (strcmp(selector, "ifFalse:ifTrue:") == 0) {
+    codeConditional(node, valueNeeded,
+                    OP_JUMPTRUE, arg1, 0, arg2, 0);
+    return true;
+  }
+  if (strcmp(selector, "and:") == 0) {
+    codeConditional(node, valueNeeded,
+                    OP_JUMPFALSE, arg1, 0, NULL, OP_PUSHFALSE);
+    return true;
+  }
+  if (strcmp(selector, "or:") == 0) {
+    codeConditional(node, valueNeeded,
+                    OP_JUMPTRUE, arg1, 0, NULL, OP_PUSHTRUE);
+    return true;
+  }
+  if (!isInlineBlock(receiver)) {
+    return false;
+  }
+  if (strcmp(selector, "whileTrue:") == 0) {
+    codeLoop(node, valueNeeded, OP_JUMPFALSE, arg1);
+    return true;
+  }
+  if (strcmp(selector, "whileFalse:") == 0) {
+    codeLoop(node, valueNeeded, OP_JUMPTRUE, arg1);
+    return true;
+  }
+  if (strcmp(selector, "whileTrue") == 0) {
+    codeLoop(node, valueNeeded, OP_JUMPFALSE, NULL);
+    return true;
+  }
+  if (strcmp(selector, "whileFalse") == 0) {
+    codeLoop(node, valueNeeded, OP_JUMPTRUE, NULL);
+    return true;
+  }
+  return false;
+}
+
+
+static void codeMessage(Node *node, Bool valueNeeded) {
+  List *arguments;
+
+  /* control structures with literal blocks are coded in line */
+  if (codeControl(node, valueNeeded)) {
+    return;
+  }
+
+  /* ATTENTION: if we have a null receiver (a cascaded message)
+     then do nothing since the receiver has already been pushed */
+  if (node->u.messageNode.receiver != NULL) {
+    codeNode(node->u.messageNode.receiver, true);
+  }
+  arguments = node->u.messageNode.arguments;
+  while (arguments != NULL) {
+    codeNode(arguments->head, true);
+    arguments = arguments->tail;
+  }
+  codeSend(node, valueNeeded);
+}
+
+
 static void codeVar(Node *node, Bool valueNeeded) {
   if (valueNeeded) {
     codeLoad(node);
@@ -448,7 +843,11 @@ static ObjPtr codeLiteral(Node *node) {
       }
       break;
     case Int:
-      literal = newShortInteger(node->u.intNode.val);
+      if (node->u.intNode.digits != NULL) {
+        literal = parseInteger(node->u.intNode.digits);
+      } else {
+        literal = newInteger(node->u.intNode.val);
+      }
       break;
     case Float:
       literal = newFloat(node->u.floatNode.val);
@@ -492,6 +891,129 @@ static ObjPtr codeLiteral(Node *node) {
 }
 
 
+/*
+ * A method which consists of nothing but ^<! NN self arg1 ... argn !>,
+ * with the arguments in the order of its parameters, is marked with
+ * the number of the primitive. A send can then call the primitive on
+ * its own stack, without creating a context for the method.
+ */
+
+
+static int getPrimitive(Node *method) {
+  List *statements;
+  Node *prim;
+  List *arguments;
+  Variable *variable;
+  int i;
+
+  statements = method->u.methodNode.statements;
+  if (statements == NULL ||
+      statements->tail != NULL ||
+      statements->head->type != Return) {
+    return -1;
+  }
+  prim = statements->head->u.returnNode.expression;
+  if (prim->type != Prim ||
+      prim->u.primNode.numArgs != method->u.methodNode.numArgs + 1) {
+    return -1;
+  }
+  arguments = prim->u.primNode.arguments;
+  for (i = -1; arguments != NULL; i++) {
+    if (arguments->head->type != Var) {
+      return -1;
+    }
+    variable = arguments->head->u.varNode.var;
+    if (i < 0 ? variable->type != Self :
+                variable->type != Argument || variable->offset != i) {
+      return -1;
+    }
+    arguments = arguments->tail;
+  }
+  return prim->u.primNode.number;
+}
+
+
+/*
+ * Methods which only answer self, a constant or an instance
+ * variable, or only store their argument into an instance
+ * variable, are marked as quick methods. A send executes them
+ * in place, again without creating a context.
+ */
+
+
+static int getStoreQuick(Node *method, Node *assign) {
+  Variable *lhs, *rhs;
+
+  if (method->u.methodNode.numArgs != 1 ||
+      assign->u.assignNode.rhs->type != Var) {
+    return -1;
+  }
+  lhs = assign->u.assignNode.lhs->u.varNode.var;
+  rhs = assign->u.assignNode.rhs->u.varNode.var;
+  if (lhs->type != Instance || rhs->type != Argument) {
+    return -1;
+  }
+  return lhs->offset;
+}
+
+
+static int getQuick(Node *method) {
+  List *statements;
+  Node *statement;
+  Node *expression;
+  Variable *variable;
+  int offset;
+
+  statements = method->u.methodNode.statements;
+  if (statements == NULL) {
+    return QUICK_SELF;
+  }
+  if (statements->tail != NULL) {
+    return -1;
+  }
+  statement = statements->head;
+  if (statement->type == Assign) {
+    offset = getStoreQuick(method, statement);
+    return offset < 0 ? -1 : QUICK_STORE | offset << 8;
+  }
+  if (statement->type != Return) {
+    return -1;
+  }
+  expression = statement->u.returnNode.expression;
+  switch (expression->type) {
+    case Assign:
+      offset = getStoreQuick(method, expression);
+      return offset < 0 ? -1 : QUICK_STORERET | offset << 8;
+    case Var:
+      variable = expression->u.varNode.var;
+      switch (variable->type) {
+        case Self:
+          return QUICK_SELF;
+        case Nil:
+          return QUICK_NIL;
+        case False:
+          return QUICK_FALSE;
+        case True:
+          return QUICK_TRUE;
+        case Instance:
+          return QUICK_INST | variable->offset << 8;
+        default:
+          return -1;
+      }
+    case Int:
+    case Float:
+    case Char:
+    case String:
+    case Symbol:
+    case Array:
+      /* the only literal of the method */
+      return QUICK_CONST | 0 << 8;
+    default:
+      return -1;
+  }
+}
+
+
 void code(char *text, Node *method, ObjPtr class, Bool valueNeeded) {
   ObjPtr aux;
   int i;
@@ -501,6 +1023,8 @@ void code(char *text, Node *method, ObjPtr class, Bool valueNeeded) {
   literalSize = 0;
   maxStacksize = 0;
   currentStacksize = 0;
+  firstHiddenTemp = method->u.methodNode.numTemps;
+  numHiddenTemps = 0;
   codeNode(method, valueNeeded);
   machine.compilerMethod = class;
   aux = createObject(machine.Method, SIZE_OF_METHOD, true, false);
@@ -511,11 +1035,9 @@ void code(char *text, Node *method, ObjPtr class, Bool valueNeeded) {
   aux = newSymbol(method->u.methodNode.selector);
   setPtr(machine.compilerMethod, SELECTOR_IN_METHOD, aux);
   if (instrSize != 0) {
-    aux = createObject(machine.WordArray, instrSize, false, true);
+    aux = createRawObject(machine.WordArray, instrSize, true);
+    memcpy(body(aux), instrArray, instrSize * sizeof(Word));
     setPtr(machine.compilerMethod, CODE_IN_METHOD, aux);
-    for (i = 0; i < instrSize; i++) {
-      setWord(aux, i, instrArray[i]);
-    }
   } else {
     setPtr(machine.compilerMethod, CODE_IN_METHOD, machine.nil);
   }
@@ -532,10 +1054,23 @@ void code(char *text, Node *method, ObjPtr class, Bool valueNeeded) {
   }
   aux = newShortInteger(method->u.methodNode.numArgs);
   setPtr(machine.compilerMethod, ARGSIZE_IN_METHOD, aux);
-  aux = newShortInteger(method->u.methodNode.numTemps);
+  aux = newShortInteger(method->u.methodNode.numTemps + numHiddenTemps);
   setPtr(machine.compilerMethod, TEMPSIZE_IN_METHOD, aux);
   aux = newShortInteger(maxStacksize);
   setPtr(machine.compilerMethod, STACKSIZE_IN_METHOD, aux);
+  if (getPrimitive(method) >= 0) {
+    aux = newShortInteger(getPrimitive(method));
+    setPtr(machine.compilerMethod, PRIMITIVE_IN_METHOD, aux);
+  } else {
+    setPtr(machine.compilerMethod, PRIMITIVE_IN_METHOD, machine.nil);
+  }
+  /* when valueNeeded is true, the last expression is answered */
+  if (!valueNeeded && getQuick(method) >= 0) {
+    aux = newShortInteger(getQuick(method));
+    setPtr(machine.compilerMethod, QUICK_IN_METHOD, aux);
+  } else {
+    setPtr(machine.compilerMethod, QUICK_IN_METHOD, machine.nil);
+  }
 }
 
 
@@ -642,6 +1177,30 @@ static void showInstr(int instrNum) {
       /* jump */
       printf("JUMP        0x%04X", operand2);
       break;
+    case OP_JUMPTRUE:
+      /* jump if true */
+      printf("JUMPTRUE    0x%04X", operand2);
+      break;
+    case OP_JUMPFALSE:
+      /* jump if false */
+      printf("JUMPFALSE   0x%04X", operand2);
+      break;
+    case OP_FORPREP:
+      /* prepare counted loop */
+      printf("FORPREP     %u,0x%04X", operand1, operand2);
+      break;
+    case OP_FORTEST:
+      /* test counted loop */
+      printf("FORTEST     %u,0x%04X", operand1, operand2);
+      break;
+    case OP_FORSTEP:
+      /* step counted loop */
+      printf("FORSTEP     %u,0x%04X", operand1, operand2);
+      break;
+    case OP_SENDSPECIAL:
+      /* send special selector */
+      printf("SENDSPECIAL %u,%u", operand1, operand2);
+      break;
     default:
       /* unknown opcode */
       printf("???         ");
@@ -671,7 +1230,11 @@ static void showLiteral(int litNum) {
       printf("Global(#%s)\n", variable->name);
       break;
     case Int:
-      printf("%d\n", node->u.intNode.val);
+      if (node->u.intNode.digits != NULL) {
+        printf("%s\n", node->u.intNode.digits);
+      } else {
+        printf("%ld\n", node->u.intNode.val);
+      }
       break;
     case Float:
       printf("%e\n", node->u.floatNode.val);
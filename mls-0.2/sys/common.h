@@ -23,16 +23,25 @@
 #define K		1024
 #define M		(K * K)
 
-#define ALIGN		(1 << 2)	/* architecture dependant alignment */
+#define ALIGN		(1 << 3)	/* architecture dependant alignment */
 #define ALIGN_MASK	(ALIGN - 1)	/* alignment mask */
 
-#define SEMI_SIZE	(300 * K)	/* size of a single semispace */
-#define MEMORY_SIZE	(2 * SEMI_SIZE)	/* total size of object memory */
+#define SEMI_SIZE	(300 * K)	/* default initial and minimal size
+					   of a single semispace */
+#define NURSERY_SIZE	(128 * K)	/* default size of the nursery, must
+					   not be smaller than the stack zone */
+#define STACK_SIZE	(128 * K)	/* size of the context stack zone */
 
 #define LINE_SIZE	200		/* used for line buffer */
 #define METHOD_SIZE	20000		/* used for method buffer */
 
 
+/* identity hashes are kept in the object header, */
+/* so they are restricted to a few bits */
+
+#define HASH_MASK	((1 << 15) - 1)
+
+
 /* boolean type */
 
 typedef enum { false, true } Bool;
@@ -54,10 +63,4 @@ typedef Address ObjPtr;
 #define WORD_TSB	(((Word) 1) << (8 * sizeof(Word) - 3))
 
 
-/* most and next significant bit of object pointers */
-
-#define OBJPTR_MSB	(((ObjPtr) 1) << (8 * sizeof(ObjPtr) - 1))
-#define OBJPTR_NSB	(((ObjPtr) 1) << (8 * sizeof(ObjPtr) - 2))
-
-
 #endif /* _COMMON_H_ */
@@ -0,0 +1,308 @@
+/*
+ * compress.c -- compression of object memory in image files
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "compress.h"
+
+
+/**************************************************************/
+
+/* macros */
+
+
+/* object memory is cut into blocks, each of which is preceded */
+/* by a four-byte little-endian header giving the length of */
+/* its data; a block which does not get smaller is stored as */
+/* it is, which is flagged by the top bit of the header */
+
+#define BLOCK_SIZE	(128 * K)
+#define BLOCK_STORED	0x80000000
+
+/* a compressed block is a sequence of LZ77 steps, each of */
+/* which copies literal bytes and then repeats a match from */
+/* the bytes written before; a token byte holds the number */
+/* of literals in its upper and the length of the match less */
+/* MIN_MATCH in its lower four bits, either of which is */
+/* continued by extra bytes if all bits are set; the literals */
+/* and a two-byte offset of the match follow; the last step */
+/* of a block has no match, and matches may reach back into */
+/* previous blocks, so that blocks are expanded in order */
+
+#define MIN_MATCH	4
+#define MAX_OFFSET	0xFFFF
+#define HASH_BITS	16
+#define HASH_SIZE	(1 << HASH_BITS)
+
+
+/**************************************************************/
+
+/* compression */
+
+
+static long *hashTable;		/* last position of each 4-byte hash */
+
+
+static unsigned int hashAt(Byte *p) {
+  unsigned int v;
+
+  memcpy(&v, p, sizeof(v));
+  return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+
+static Byte *putLength(Byte *out, long length) {
+  while (length >= 255) {
+    *out++ = 255;
+    length -= 255;
+  }
+  *out++ = length;
+  return out;
+}
+
+
+static Byte *putStep(Byte *out, Byte *literals, long numLiterals,
+                     long offset, long matchLength) {
+  Byte *token;
+
+  /* a match length of 0 marks the last step of a block */
+  token = out++;
+  *token = (numLiterals < 15 ? numLiterals : 15) << 4;
+  if (numLiterals >= 15) {
+    out = putLength(out, numLiterals - 15);
+  }
+  memcpy(out, literals, numLiterals);
+  out += numLiterals;
+  if (matchLength == 0) {
+    return out;
+  }
+  matchLength -= MIN_MATCH;
+  *token |= matchLength < 15 ? matchLength : 15;
+  *out++ = offset & 0xFF;
+  *out++ = offset >> 8;
+  if (matchLength >= 15) {
+    out = putLength(out, matchLength - 15);
+  }
+  return out;
+}
+
+
+static long compressBlock(Byte *data, long start, long end, Byte *out) {
+  Byte *base;
+  long anchor;
+  long pos;
+  long ref;
+  long length;
+  unsigned int h;
+
+  /* greedy parsing, finding matches through a hash table of */
+  /* the positions where 4-byte sequences were seen last; the */
+  /* search takes longer strides while no match is found */
+  base = out;
+  anchor = start;
+  pos = start;
+  while (pos + MIN_MATCH <= end) {
+    h = hashAt(data + pos);
+    ref = hashTable[h];
+    hashTable[h] = pos;
+    if (pos - ref > MAX_OFFSET ||
+        memcmp(data + ref, data + pos, MIN_MATCH) != 0) {
+      pos += 1 + ((pos - anchor) >> 6);
+      continue;
+    }
+    length = MIN_MATCH;
+    while (pos + length < end && data[ref + length] == data[pos + length]) {
+      length++;
+    }
+    out = putStep(out, data + anchor, pos - anchor, pos - ref, length);
+    pos += length;
+    anchor = pos;
+  }
+  if (anchor < end) {
+    out = putStep(out, data + anchor, end - anchor, 0, 0);
+  }
+  return out - base;
+}
+
+
+static Bool putHeader(FILE *file, unsigned long header) {
+  Byte bytes[4];
+
+  bytes[0] = header & 0xFF;
+  bytes[1] = (header >> 8) & 0xFF;
+  bytes[2] = (header >> 16) & 0xFF;
+  bytes[3] = (header >> 24) & 0xFF;
+  return fwrite(bytes, 1, 4, file) == 4;
+}
+
+
+long writeCompressed(FILE *file, Byte *data, long size) {
+  Byte *buffer;
+  long total;
+  long start;
+  long end;
+  long length;
+  int i;
+
+  /* write size bytes of data in compressed blocks, */
+  /* return the number of bytes written, or -1 on error */
+  hashTable = allocate(HASH_SIZE * sizeof(long));
+  for (i = 0; i < HASH_SIZE; i++) {
+    hashTable[i] = -(MAX_OFFSET + 1);
+  }
+  /* a block never grows by more than a byte in 15 */
+  buffer = allocate(BLOCK_SIZE + BLOCK_SIZE / 15 + 16);
+  total = 0;
+  for (start = 0; start < size; start = end) {
+    end = start + BLOCK_SIZE < size ? start + BLOCK_SIZE : size;
+    length = compressBlock(data, start, end, buffer);
+    if (length < end - start) {
+      if (!putHeader(file, length) ||
+          fwrite(buffer, 1, length, file) != length) {
+        total = -1;
+        break;
+      }
+    } else {
+      length = end - start;
+      if (!putHeader(file, length | BLOCK_STORED) ||
+          fwrite(data + start, 1, length, file) != length) {
+        total = -1;
+        break;
+      }
+    }
+    total += 4 + length;
+  }
+  release(buffer);
+  release(hashTable);
+  return total;
+}
+
+
+/**************************************************************/
+
+/* expansion */
+
+
+static Bool getLength(Byte **in, Byte *inEnd, long *length) {
+  Byte b;
+
+  do {
+    if (*in == inEnd) {
+      return false;
+    }
+    b = *(*in)++;
+    *length += b;
+  } while (b == 255);
+  return true;
+}
+
+
+static Bool expandBlock(Byte *in, long inLength,
+                        Byte *data, long start, long end) {
+  Byte *inEnd;
+  Byte token;
+  long pos;
+  long length;
+  long offset;
+
+  /* every length and offset is checked, so that a corrupt */
+  /* image cannot write outside of the block */
+  inEnd = in + inLength;
+  pos = start;
+  while (pos < end) {
+    if (in == inEnd) {
+      return false;
+    }
+    token = *in++;
+    length = token >> 4;
+    if (length == 15 && !getLength(&in, inEnd, &length)) {
+      return false;
+    }
+    if (length > inEnd - in || length > end - pos) {
+      return false;
+    }
+    memcpy(data + pos, in, length);
+    in += length;
+    pos += length;
+    if (pos == end) {
+      break;
+    }
+    if (inEnd - in < 2) {
+      return false;
+    }
+    offset = in[0] | (in[1] << 8);
+    in += 2;
+    length = (token & 15) + MIN_MATCH;
+    if ((token & 15) == 15 && !getLength(&in, inEnd, &length)) {
+      return false;
+    }
+    if (offset == 0 || offset > pos || length > end - pos) {
+      return false;
+    }
+    if (offset >= length) {
+      memcpy(data + pos, data + pos - offset, length);
+      pos += length;
+    } else {
+      /* the match overlaps the bytes it produces */
+      while (length-- > 0) {
+        data[pos] = data[pos - offset];
+        pos++;
+      }
+    }
+  }
+  return in == inEnd;
+}
+
+
+static Bool getHeader(FILE *file, unsigned long *header) {
+  Byte bytes[4];
+
+  if (fread(bytes, 1, 4, file) != 4) {
+    return false;
+  }
+  *header = (unsigned long) bytes[0] |
+            ((unsigned long) bytes[1] << 8) |
+            ((unsigned long) bytes[2] << 16) |
+            ((unsigned long) bytes[3] << 24);
+  return true;
+}
+
+
+Bool readCompressed(FILE *file, Byte *data, long size) {
+  Byte *buffer;
+  unsigned long header;
+  long start;
+  long end;
+  long length;
+  Bool ok;
+
+  /* read size bytes of data from compressed blocks; each */
+  /* block is expanded straight into data as soon as it is */
+  /* read, stored blocks are read into data directly */
+  buffer = allocate(BLOCK_SIZE);
+  ok = true;
+  for (start = 0; start < size && ok; start = end) {
+    end = start + BLOCK_SIZE < size ? start + BLOCK_SIZE : size;
+    if (!getHeader(file, &header)) {
+      ok = false;
+      break;
+    }
+    length = header & ~BLOCK_STORED;
+    if (header & BLOCK_STORED) {
+      ok = length == end - start &&
+           fread(data + start, 1, length, file) == length;
+    } else {
+      ok = length < end - start &&
+           fread(buffer, 1, length, file) == length &&
+           expandBlock(buffer, length, data, start, end);
+    }
+  }
+  release(buffer);
+  return ok;
+}
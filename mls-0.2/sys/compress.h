@@ -0,0 +1,14 @@
+/*
+ * compress.h -- compression of object memory in image files
+ */
+
+
+#ifndef _COMPRESS_H_
+#define _COMPRESS_H_
+
+
+long writeCompressed(FILE *file, Byte *data, long size);
+Bool readCompressed(FILE *file, Byte *data, long size);
+
+
+#endif /* _COMPRESS_H_ */
@@ -0,0 +1,380 @@
+/*
+ * largeint.c -- integers of any size
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "machine.h"
+#include "objects.h"
+#include "memory.h"
+#include "largeint.h"
+#include "ui.h"
+
+
+/*
+ * Integers which do not fit into a short integer are byte objects
+ * of class LargePositiveInteger or LargeNegativeInteger, holding
+ * the magnitude of the integer as little-endian digits of base 256
+ * without leading zeros, so that they read the same on every
+ * machine. Every result is answered as a short integer if it fits,
+ * so that the two representations of an integer never overlap.
+ * The arithmetic works on copies of the digits outside of the
+ * object memory, which cannot be moved when the result is created.
+ */
+
+
+typedef struct {
+  Bool negative;		/* sign of the integer */
+  long size;			/* number of digits */
+  Byte *digits;			/* magnitude, least significant first */
+} LargeInt;
+
+
+/**************************************************************/
+
+/* conversion */
+
+
+static void trimDigits(LargeInt *n) {
+  while (n->size > 0 && n->digits[n->size - 1] == 0) {
+    n->size--;
+  }
+}
+
+
+static void fromLong(LargeInt *n, long value) {
+  unsigned long magnitude;
+  int i;
+
+  n->negative = value < 0;
+  magnitude = value < 0 ? -(unsigned long) value : value;
+  n->size = sizeof(long);
+  n->digits = allocate(sizeof(long));
+  for (i = 0; i < sizeof(long); i++) {
+    n->digits[i] = magnitude & 0xFF;
+    magnitude >>= 8;
+  }
+  trimDigits(n);
+}
+
+
+static void fromObject(LargeInt *n, ObjPtr object) {
+  if (object & IS_SHORTINT) {
+    fromLong(n, getShortInteger(object));
+    return;
+  }
+  if (!isInteger(object)) {
+    sysError("integer arithmetic with an object which is not an integer");
+  }
+  n->negative = getClass(object) == machine.LargeNegativeInteger;
+  n->size = getSize(object);
+  n->digits = allocate(n->size + 1);
+  memcpy(n->digits, body(object), n->size);
+}
+
+
+static ObjPtr toObject(LargeInt *n) {
+  unsigned long magnitude;
+  ObjPtr object;
+  long i;
+
+  /* the digits are released */
+  trimDigits(n);
+  if (n->size <= sizeof(long)) {
+    magnitude = 0;
+    for (i = n->size - 1; i >= 0; i--) {
+      magnitude = (magnitude << 8) | n->digits[i];
+    }
+    if (magnitude <= (unsigned long) SHORTINT_MAX + n->negative) {
+      release(n->digits);
+      return newShortInteger(n->negative ? -(long) (magnitude - 1) - 1 :
+                                           (long) magnitude);
+    }
+  }
+  object = createRawObject(n->negative ? machine.LargeNegativeInteger :
+                                         machine.LargePositiveInteger,
+                           n->size, false);
+  memcpy(body(object), n->digits, n->size);
+  release(n->digits);
+  return object;
+}
+
+
+ObjPtr newInteger(long value) {
+  LargeInt n;
+
+  if (value >= SHORTINT_MIN && value <= SHORTINT_MAX) {
+    return newShortInteger(value);
+  }
+  fromLong(&n, value);
+  return toObject(&n);
+}
+
+
+ObjPtr parseInteger(char *digits) {
+  LargeInt n;
+  unsigned int carry;
+  long i;
+
+  /* digits are decimal, with an optional minus sign; each */
+  /* one multiplies the number by ten and is added to it */
+  n.negative = *digits == '-';
+  if (n.negative) {
+    digits++;
+  }
+  n.size = 0;
+  n.digits = allocate(strlen(digits) / 2 + 2);
+  for (; *digits != '\0'; digits++) {
+    carry = *digits - '0';
+    for (i = 0; i < n.size; i++) {
+      carry += n.digits[i] * 10;
+      n.digits[i] = carry & 0xFF;
+      carry >>= 8;
+    }
+    if (carry != 0) {
+      n.digits[n.size++] = carry;
+    }
+  }
+  return toObject(&n);
+}
+
+
+Bool isInteger(ObjPtr object) {
+  ObjPtr class;
+
+  if (object & IS_SHORTINT) {
+    return true;
+  }
+  class = getClass(object);
+  return class == machine.LargePositiveInteger ||
+         class == machine.LargeNegativeInteger;
+}
+
+
+/**************************************************************/
+
+/* magnitudes */
+
+
+static int compareMagnitudes(LargeInt *a, LargeInt *b) {
+  long i;
+
+  if (a->size != b->size) {
+    return a->size < b->size ? -1 : 1;
+  }
+  for (i = a->size - 1; i >= 0; i--) {
+    if (a->digits[i] != b->digits[i]) {
+      return a->digits[i] < b->digits[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+
+static void addMagnitudes(LargeInt *a, LargeInt *b, LargeInt *r) {
+  unsigned int sum;
+  long i;
+
+  if (a->size < b->size) {
+    addMagnitudes(b, a, r);
+    return;
+  }
+  r->size = a->size + 1;
+  r->digits = allocate(r->size);
+  sum = 0;
+  for (i = 0; i < a->size; i++) {
+    sum += a->digits[i] + (i < b->size ? b->digits[i] : 0);
+    r->digits[i] = sum & 0xFF;
+    sum >>= 8;
+  }
+  r->digits[a->size] = sum;
+}
+
+
+static void subtractMagnitudes(LargeInt *a, LargeInt *b, Byte *digits) {
+  int difference;
+  int borrow;
+  long i;
+
+  /* a must not be smaller than b; digits may be those of a */
+  borrow = 0;
+  for (i = 0; i < a->size; i++) {
+    difference = a->digits[i] - (i < b->size ? b->digits[i] : 0) - borrow;
+    borrow = difference < 0;
+    digits[i] = difference & 0xFF;
+  }
+}
+
+
+static void addSigned(LargeInt *a, LargeInt *b, LargeInt *r) {
+  if (a->negative == b->negative) {
+    addMagnitudes(a, b, r);
+    r->negative = a->negative;
+    return;
+  }
+  if (compareMagnitudes(a, b) < 0) {
+    addSigned(b, a, r);
+    return;
+  }
+  r->size = a->size;
+  r->digits = allocate(r->size + 1);
+  subtractMagnitudes(a, b, r->digits);
+  r->negative = a->negative;
+}
+
+
+static void multiplyMagnitudes(LargeInt *a, LargeInt *b, LargeInt *r) {
+  unsigned int product;
+  long i, j;
+
+  r->size = a->size + b->size;
+  r->digits = allocate(r->size + 1);
+  memset(r->digits, 0, r->size);
+  for (i = 0; i < a->size; i++) {
+    product = 0;
+    for (j = 0; j < b->size; j++) {
+      product += a->digits[i] * b->digits[j] + r->digits[i + j];
+      r->digits[i + j] = product & 0xFF;
+      product >>= 8;
+    }
+    r->digits[i + b->size] = product;
+  }
+}
+
+
+static void divideMagnitudes(LargeInt *a, LargeInt *b,
+                             LargeInt *q, LargeInt *r) {
+  unsigned int shifted;
+  long i, j;
+
+  /* long division, one bit of the quotient at a time: the */
+  /* remainder is always smaller than b, and never needs */
+  /* more than one digit more than b while it is shifted */
+  if (b->size == 0) {
+    sysError("integer division by zero");
+  }
+  q->size = a->size;
+  q->digits = allocate(q->size + 1);
+  memset(q->digits, 0, q->size);
+  r->size = 0;
+  r->digits = allocate(b->size + 1);
+  for (i = 8 * a->size - 1; i >= 0; i--) {
+    shifted = (a->digits[i >> 3] >> (i & 7)) & 1;
+    for (j = 0; j < r->size; j++) {
+      shifted |= r->digits[j] << 1;
+      r->digits[j] = shifted & 0xFF;
+      shifted >>= 8;
+    }
+    if (shifted != 0) {
+      r->digits[r->size++] = shifted;
+    }
+    if (compareMagnitudes(r, b) >= 0) {
+      subtractMagnitudes(r, b, r->digits);
+      trimDigits(r);
+      q->digits[i >> 3] |= 1 << (i & 7);
+    }
+  }
+}
+
+
+/**************************************************************/
+
+/* arithmetic */
+
+
+ObjPtr addIntegers(ObjPtr op1, ObjPtr op2) {
+  LargeInt a, b, r;
+
+  fromObject(&a, op1);
+  fromObject(&b, op2);
+  addSigned(&a, &b, &r);
+  release(a.digits);
+  release(b.digits);
+  return toObject(&r);
+}
+
+
+ObjPtr subtractIntegers(ObjPtr op1, ObjPtr op2) {
+  LargeInt a, b, r;
+
+  fromObject(&a, op1);
+  fromObject(&b, op2);
+  b.negative = !b.negative;
+  addSigned(&a, &b, &r);
+  release(a.digits);
+  release(b.digits);
+  return toObject(&r);
+}
+
+
+ObjPtr multiplyIntegers(ObjPtr op1, ObjPtr op2) {
+  LargeInt a, b, r;
+
+  fromObject(&a, op1);
+  fromObject(&b, op2);
+  multiplyMagnitudes(&a, &b, &r);
+  r.negative = a.negative != b.negative;
+  release(a.digits);
+  release(b.digits);
+  return toObject(&r);
+}
+
+
+ObjPtr divideIntegers(ObjPtr op1, ObjPtr op2) {
+  LargeInt a, b, q, r;
+
+  /* the quotient is truncated towards zero, like in C */
+  fromObject(&a, op1);
+  fromObject(&b, op2);
+  divideMagnitudes(&a, &b, &q, &r);
+  q.negative = a.negative != b.negative;
+  release(a.digits);
+  release(b.digits);
+  release(r.digits);
+  return toObject(&q);
+}
+
+
+ObjPtr remainderIntegers(ObjPtr op1, ObjPtr op2) {
+  LargeInt a, b, q, r;
+
+  /* the remainder has the sign of the dividend, like in C */
+  fromObject(&a, op1);
+  fromObject(&b, op2);
+  divideMagnitudes(&a, &b, &q, &r);
+  r.negative = a.negative;
+  release(a.digits);
+  release(b.digits);
+  release(q.digits);
+  return toObject(&r);
+}
+
+
+int compareIntegers(ObjPtr op1, ObjPtr op2) {
+  LargeInt a, b;
+  int result;
+
+  fromObject(&a, op1);
+  fromObject(&b, op2);
+  trimDigits(&a);
+  trimDigits(&b);
+  if (a.size == 0 && b.size == 0) {
+    result = 0;
+  } else
+  if (a.negative != b.negative) {
+    result = a.negative ? -1 : 1;
+  } else {
+    result = compareMagnitudes(&a, &b);
+    if (a.negative) {
+      result = -result;
+    }
+  }
+  release(a.digits);
+  release(b.digits);
+  return result;
+}
@@ -0,0 +1,65 @@
+/*
+ * largeint.h -- integers of any size
+ */
+
+
+#ifndef _LARGEINT_H_
+#define _LARGEINT_H_
+
+
+/* arithmetic on two short integers, which works on the tagged */
+/* values (see memory.h); it answers false if the result does */
+/* not fit into a short integer, in which case the functions */
+/* below must be used */
+
+static inline Bool addShortIntegers(ObjPtr op1, ObjPtr op2,
+                                    ObjPtr *result) {
+  long value;
+
+  if (__builtin_add_overflow((long) op1, (long) (op2 - IS_SHORTINT),
+                             &value)) {
+    return false;
+  }
+  *result = value;
+  return true;
+}
+
+
+static inline Bool subtractShortIntegers(ObjPtr op1, ObjPtr op2,
+                                         ObjPtr *result) {
+  long value;
+
+  if (__builtin_sub_overflow((long) op1, (long) (op2 - IS_SHORTINT),
+                             &value)) {
+    return false;
+  }
+  *result = value;
+  return true;
+}
+
+
+static inline Bool multiplyShortIntegers(ObjPtr op1, ObjPtr op2,
+                                         ObjPtr *result) {
+  long value;
+
+  if (__builtin_mul_overflow((long) op1 >> SHORTINT_SHIFT,
+                             (long) (op2 - IS_SHORTINT), &value)) {
+    return false;
+  }
+  *result = value | IS_SHORTINT;
+  return true;
+}
+
+
+ObjPtr newInteger(long value);
+ObjPtr parseInteger(char *digits);
+Bool isInteger(ObjPtr object);
+ObjPtr addIntegers(ObjPtr op1, ObjPtr op2);
+ObjPtr subtractIntegers(ObjPtr op1, ObjPtr op2);
+ObjPtr multiplyIntegers(ObjPtr op1, ObjPtr op2);
+ObjPtr divideIntegers(ObjPtr op1, ObjPtr op2);
+ObjPtr remainderIntegers(ObjPtr op1, ObjPtr op2);
+int compareIntegers(ObjPtr op1, ObjPtr op2);
+
+
+#endif /* _LARGEINT_H_ */
@@ -8,10 +8,12 @@
 #include <string.h>
 
 #include "common.h"
+#include "utils.h"
 #include "machine.h"
 #include "prims.h"
 #include "objects.h"
 #include "memory.h"
+#include "largeint.h"
 #include "ui.h"
 
 #include "getline.h"
@@ -23,8 +25,10 @@
 
 
 Machine machine;		/* an instance of the virtual machine */
-Bool debugMachine = false;	/* operate VM in debug mode if set */
+Bool debugMachine = false;	/* operate VM in debug mode if set,
+				   i.e. use the checked interpreter */
 Bool runMachine = true;		/* while true, run the machine */
+Bool statsMachine = false;	/* count VM events and show them at exit */
 
 
 /**************************************************************/
@@ -157,7 +161,7 @@ static void showBrief(ObjPtr obj) {
 
   class = getClass(obj);
   if (class == machine.ShortInteger) {
-    printf("integer %d", getShortInteger(obj));
+    printf("integer %ld", getShortInteger(obj));
   } else {
     printf("object @ 0x%08lX ", obj);
     showClassInfo(class);
@@ -240,7 +244,7 @@ static void showLiteral(ObjPtr literal) {
 
   class = getClass(literal);
   if (class == machine.ShortInteger) {
-    printf("%d", getShortInteger(literal));
+    printf("%ld", getShortInteger(literal));
   } else
   if (class == machine.Float) {
     printf("%e", getFloat(literal));
@@ -378,6 +382,31 @@ static void showInstruction(Word ip,
       /* jump */
       printf("JUMP        0x%04X", operand2);
       break;
+    case OP_JUMPTRUE:
+      /* jump if true */
+      printf("JUMPTRUE    0x%04X", operand2);
+      break;
+    case OP_JUMPFALSE:
+      /* jump if false */
+      printf("JUMPFALSE   0x%04X", operand2);
+      break;
+    case OP_FORPREP:
+      /* prepare counted loop */
+      printf("FORPREP     %u,0x%04X", operand1, operand2);
+      break;
+    case OP_FORTEST:
+      /* test counted loop */
+      printf("FORTEST     %u,0x%04X", operand1, operand2);
+      break;
+    case OP_FORSTEP:
+      /* step counted loop */
+      printf("FORSTEP     %u,0x%04X", operand1, operand2);
+      break;
+    case OP_SENDSPECIAL:
+      /* send special selector */
+      printf("SENDSPECIAL %u,%u\t  ; ", operand1, operand2);
+      showLiteral(getPtr(literals, operand2));
+      break;
     default:
       /* unknown opcode */
       printf("???         ");
@@ -540,9 +569,6 @@ void push(ObjPtr object) {
          machine.sp,
          object);
   machine.sp++;
-  setPtr(machine.currentActiveContext,
-         SP_IN_CONTEXT,
-         newShortInteger(machine.sp));
 }
 
 
@@ -550,9 +576,6 @@ ObjPtr pop(void) {
   ObjPtr object;
 
   machine.sp--;
-  setPtr(machine.currentActiveContext,
-         SP_IN_CONTEXT,
-         newShortInteger(machine.sp));
   object = getPtr(machine.currentStack, machine.sp);
   setPtr(machine.currentStack,
          machine.sp,
@@ -561,7 +584,20 @@ ObjPtr pop(void) {
 }
 
 
+void saveContext(void) {
+  /* ip and sp live in machine registers while a context */
+  /* runs, write them back so that the context is complete */
+  setPtr(machine.currentActiveContext,
+         IP_IN_CONTEXT,
+         newShortInteger(machine.ip));
+  setPtr(machine.currentActiveContext,
+         SP_IN_CONTEXT,
+         newShortInteger(machine.sp));
+}
+
+
 void activateContext(ObjPtr context) {
+  saveContext();
   machine.currentActiveContext = context;
   if (getClass(context) == machine.MethodContext) {
     /* the new context is a MethodContext */
@@ -588,6 +624,244 @@ void activateContext(ObjPtr context) {
     getShortInteger(getPtr(machine.currentActiveContext, IP_IN_CONTEXT));
   machine.sp =
     getShortInteger(getPtr(machine.currentActiveContext, SP_IN_CONTEXT));
+  /* pushes and stores to temporaries have no write barrier */
+  rememberObject(machine.currentTemps);
+  rememberObject(machine.currentStack);
+}
+
+
+/**************************************************************/
+
+/* context stack */
+
+
+/*
+ * Method contexts are allocated in the stack zone of the object
+ * memory, preceded by their argument, temporary, and stack arrays.
+ * They are ordinary objects, so the machine accesses them as usual,
+ * but they are released in LIFO order when their method returns,
+ * without any help from the garbage collector. A context is moved
+ * into the heap as soon as it might outlive its activation: when it
+ * becomes the home of a block, when the debugger is entered, and
+ * when the machine stops, since the image holds no stack zone. If
+ * the stack zone is full or the machine runs in debug mode, method
+ * contexts are allocated in the heap right away.
+ *
+ * Heap contexts point to stack contexts only by their caller fields
+ * and only while they are part of the active chain of contexts;
+ * this is why returns clear the caller fields of contexts they leave.
+ * The active context, if it is a stack context, is always the top
+ * of the stack zone.
+ */
+
+
+#define FRAME_LENGTH(argSize, tempSize, stackSize) \
+  ((argSize == 0 ? 0 : HEADER_SIZE + argSize * sizeof(ObjPtr)) + \
+   (tempSize == 0 ? 0 : HEADER_SIZE + tempSize * sizeof(ObjPtr)) + \
+   (stackSize == 0 ? 0 : HEADER_SIZE + stackSize * sizeof(ObjPtr)) + \
+   HEADER_SIZE + SIZE_OF_METHODCONTEXT * sizeof(ObjPtr))
+
+
+static unsigned long stackContexts = 0;
+static unsigned long heapContexts = 0;
+static unsigned long movedContexts = 0;
+static unsigned long quickMethods = 0;
+static unsigned long primitiveMethods = 0;
+
+
+static Address frameStart(ObjPtr context) {
+  ObjPtr object;
+
+  /* the first object of the frame of a stack context */
+  object = getPtr(context, ARGS_IN_METHODCONTEXT);
+  if (object != machine.nil) {
+    return object;
+  }
+  object = getPtr(context, TEMPS_IN_METHODCONTEXT);
+  if (object != machine.nil) {
+    return object;
+  }
+  object = getPtr(context, STACK_IN_METHODCONTEXT);
+  if (object != machine.nil) {
+    return object;
+  }
+  return context;
+}
+
+
+static ObjPtr moveContext(ObjPtr context) {
+  ObjPtr copy;
+  ObjPtr object;
+
+  /* the caller must have reserved enough memory */
+  copy = moveToHeap(context);
+  object = getPtr(copy, ARGS_IN_METHODCONTEXT);
+  if (object != machine.nil) {
+    setPtr(copy, ARGS_IN_METHODCONTEXT, moveToHeap(object));
+  }
+  object = getPtr(copy, TEMPS_IN_METHODCONTEXT);
+  if (object != machine.nil) {
+    setPtr(copy, TEMPS_IN_METHODCONTEXT, moveToHeap(object));
+  }
+  object = getPtr(copy, STACK_IN_METHODCONTEXT);
+  if (object != machine.nil) {
+    setPtr(copy, STACK_IN_METHODCONTEXT, moveToHeap(object));
+  }
+  movedContexts++;
+  /* the machine registers may refer to the context */
+  if (machine.currentActiveContext == context) {
+    machine.currentActiveContext = copy;
+    machine.currentStack = getPtr(copy, STACK_IN_METHODCONTEXT);
+  }
+  if (machine.currentHomeContext == context) {
+    machine.currentHomeContext = copy;
+    machine.currentArgs = getPtr(copy, ARGS_IN_METHODCONTEXT);
+    machine.currentTemps = getPtr(copy, TEMPS_IN_METHODCONTEXT);
+  }
+  return copy;
+}
+
+
+static void materializeHome(void) {
+  Address start;
+
+  /* the home context is the active one, so it is on top */
+  start = frameStart(machine.currentHomeContext);
+  reserveMemory(stackTop - start);
+  moveContext(machine.currentHomeContext);
+  stackTop = start;
+}
+
+
+static void materializeAll(void) {
+  ObjPtr context;
+  ObjPtr previous;
+  Address start;
+
+  if (stackTop == stackStart) {
+    return;
+  }
+  reserveMemory(stackTop - stackStart);
+  /* all stack contexts are found in the active chain */
+  previous = machine.nil;
+  context = machine.currentActiveContext;
+  while (context != machine.nil) {
+    if (isStackObject(context)) {
+      start = frameStart(context);
+      context = moveContext(context);
+      if (previous != machine.nil) {
+        setPtr(previous, CALLER_IN_CONTEXT, context);
+      }
+      if (start == stackStart) {
+        break;
+      }
+    }
+    previous = context;
+    context = getPtr(context, CALLER_IN_CONTEXT);
+  }
+  stackTop = stackStart;
+}
+
+
+static void createStackContext(int argSize, int tempSize, int stackSize) {
+  ObjPtr args;
+  ObjPtr temps;
+  ObjPtr stack;
+  int i;
+
+  args = machine.nil;
+  if (argSize != 0) {
+    args = createRawStackObject(machine.Array, argSize);
+    for (i = 1; i <= argSize; i++) {
+      setPtr(args, argSize - i, pop());
+    }
+  }
+  temps = machine.nil;
+  if (tempSize != 0) {
+    temps = createStackObject(machine.Array, tempSize);
+  }
+  stack = machine.nil;
+  if (stackSize != 0) {
+    stack = createStackObject(machine.Array, stackSize);
+  }
+  machine.newContext =
+    createStackObject(machine.MethodContext, SIZE_OF_METHODCONTEXT);
+  setPtr(machine.newContext,
+         CALLER_IN_METHODCONTEXT,
+         machine.currentActiveContext);
+  setPtr(machine.newContext,
+         IP_IN_METHODCONTEXT,
+         newShortInteger(0));
+  setPtr(machine.newContext,
+         STACK_IN_METHODCONTEXT,
+         stack);
+  setPtr(machine.newContext,
+         SP_IN_METHODCONTEXT,
+         newShortInteger(0));
+  setPtr(machine.newContext,
+         METHOD_IN_METHODCONTEXT,
+         machine.newMethod);
+  setPtr(machine.newContext,
+         ARGS_IN_METHODCONTEXT,
+         args);
+  setPtr(machine.newContext,
+         RECEIVER_IN_METHODCONTEXT,
+         pop());
+  setPtr(machine.newContext,
+         TEMPS_IN_METHODCONTEXT,
+         temps);
+  stackContexts++;
+}
+
+
+static void returnFromMethod(void) {
+  ObjPtr caller;
+  ObjPtr context, next;
+  Address top;
+
+  /* get context to which we should return */
+  caller = getPtr(machine.currentHomeContext, CALLER_IN_METHODCONTEXT);
+  /* check that we do not try to return from a
+     context that we have already returned from */
+  if (caller == machine.nil) {
+    sysError("cannot return");
+  }
+  /* set flag that we cannot return again */
+  setPtr(machine.currentHomeContext,
+         CALLER_IN_METHODCONTEXT,
+         machine.nil);
+  /* a return from a block also leaves all contexts up */
+  /* to the home context, none of them may return later */
+  top = stackTop;
+  context = machine.currentActiveContext;
+  while (context != machine.currentHomeContext && context != machine.nil) {
+    next = getPtr(context, CALLER_IN_CONTEXT);
+    setPtr(context, CALLER_IN_CONTEXT, machine.nil);
+    if (isStackObject(context)) {
+      top = frameStart(context);
+    }
+    context = next;
+  }
+  if (isStackObject(machine.currentHomeContext)) {
+    top = frameStart(machine.currentHomeContext);
+  }
+  /* change contexts, then release the stack contexts left */
+  activateContext(caller);
+  stackTop = top;
+}
+
+
+static void returnFromBlock(void) {
+  ObjPtr caller;
+
+  /* get context to which we should return */
+  caller = getPtr(machine.currentActiveContext, CALLER_IN_BLOCKCONTEXT);
+  /* the block does not need its caller any longer */
+  setPtr(machine.currentActiveContext,
+         CALLER_IN_BLOCKCONTEXT,
+         machine.nil);
+  /* change contexts */
+  activateContext(caller);
 }
 
 
@@ -599,6 +873,10 @@ void activateContext(ObjPtr context) {
 static void createBlockContext(int numArgs, int stackSize) {
   ObjPtr stack;
 
+  /* the home context will be referenced by the block */
+  if (isStackObject(machine.currentHomeContext)) {
+    materializeHome();
+  }
   machine.newContext =
     createObject(machine.BlockContext, SIZE_OF_BLOCKCONTEXT, true, false);
   if (stackSize != 0) {
@@ -659,12 +937,102 @@ static ObjPtr findMethod(ObjPtr initialClass, ObjPtr selector) {
 }
 
 
-static void executeNewMethod(void) {
-  int stackSize;
+/**************************************************************/
+
+/* global method cache */
+
+
+#define METHOD_CACHE_SIZE	1024	/* must be a power of 2 */
+
+
+typedef struct {
+  ObjPtr class;
+  ObjPtr selector;
+  ObjPtr method;
+} MethodCacheEntry;
+
+
+static MethodCacheEntry methodCache[METHOD_CACHE_SIZE];
+
+static unsigned long methodCacheHits = 0;
+static unsigned long methodCacheMisses = 0;
+static unsigned long methodCacheFlushes = 0;
+static unsigned long selectorFlushes = 0;
+static unsigned long methodCacheEpoch = 0;	/* counts flushes */
+
+
+/*
+ * The cache is indexed by the hash values stored in the
+ * headers of class and selector. These are copied by the
+ * garbage collector, so an entry stays in its slot when the
+ * objects move; only the pointers in it must be updated.
+ */
+static inline MethodCacheEntry *methodCacheEntry(ObjPtr class,
+                                                 ObjPtr selector) {
+  return &methodCache[(getHash(class) ^ getHash(selector)) &
+                      (METHOD_CACHE_SIZE - 1)];
+}
+
+
+static ObjPtr lookupMethod(ObjPtr class, ObjPtr selector) {
+  MethodCacheEntry *entry;
+
+  entry = methodCacheEntry(class, selector);
+  if (entry->class == class && entry->selector == selector) {
+    methodCacheHits++;
+    return entry->method;
+  }
+  methodCacheMisses++;
+  entry->method = findMethod(class, selector);
+  entry->class = class;
+  entry->selector = selector;
+  return entry->method;
+}
+
+
+void flushMethodCache(void) {
+  int i;
+
+  for (i = 0; i < METHOD_CACHE_SIZE; i++) {
+    methodCache[i].class = machine.nil;
+    methodCache[i].selector = machine.nil;
+    methodCache[i].method = machine.nil;
+  }
+  methodCacheFlushes++;
+  /* this also invalidates all send site caches */
+  methodCacheEpoch++;
+}
+
+
+static void relocateMethodCache(void) {
+  MethodCacheEntry *entry;
+  int i;
+
+  for (i = 0; i < METHOD_CACHE_SIZE; i++) {
+    entry = &methodCache[i];
+    if (entry->class == machine.nil) {
+      continue;
+    }
+    entry->class = survivor(entry->class);
+    entry->selector = survivor(entry->selector);
+    entry->method = survivor(entry->method);
+    if (entry->class == machine.nil ||
+        entry->selector == machine.nil ||
+        entry->method == machine.nil) {
+      entry->class = machine.nil;
+      entry->selector = machine.nil;
+      entry->method = machine.nil;
+    }
+  }
+}
+
+
+/**************************************************************/
+
+
+static void createHeapContext(int argSize, int tempSize, int stackSize) {
   ObjPtr stack;
-  int argSize;
   ObjPtr args;
-  int tempSize;
   ObjPtr temps;
   int i;
 
@@ -677,8 +1045,6 @@ static void executeNewMethod(void) {
   setPtr(machine.newContext,
          IP_IN_METHODCONTEXT,
          newShortInteger(0));
-  stackSize =
-    getShortInteger(getPtr(machine.newMethod, STACKSIZE_IN_METHOD));
   if (stackSize != 0) {
     stack = createObject(machine.Array, stackSize, true, false);
     setPtr(machine.newContext,
@@ -691,8 +1057,6 @@ static void executeNewMethod(void) {
   setPtr(machine.newContext,
          METHOD_IN_METHODCONTEXT,
          machine.newMethod);
-  argSize =
-    getShortInteger(getPtr(machine.newMethod, ARGSIZE_IN_METHOD));
   if (argSize != 0) {
     args = createObject(machine.Array, argSize, true, false);
     setPtr(machine.newContext,
@@ -705,14 +1069,101 @@ static void executeNewMethod(void) {
   setPtr(machine.newContext,
          RECEIVER_IN_METHODCONTEXT,
          pop());
-  tempSize =
-    getShortInteger(getPtr(machine.newMethod, TEMPSIZE_IN_METHOD));
   if (tempSize != 0) {
     temps = createObject(machine.Array, tempSize, true, false);
     setPtr(machine.newContext,
            TEMPS_IN_METHODCONTEXT,
            temps);
   }
+  heapContexts++;
+}
+
+
+static void executeQuick(int quick, int argSize) {
+  ObjPtr receiver;
+  ObjPtr argument;
+  ObjPtr result;
+  int index;
+
+  receiver = getPtr(machine.currentStack, machine.sp - argSize - 1);
+  argument = getPtr(machine.currentStack, machine.sp - 1);
+  index = quick >> 8;
+  switch (quick & 0xFF) {
+    case QUICK_SELF:
+      result = receiver;
+      break;
+    case QUICK_NIL:
+      result = machine.nil;
+      break;
+    case QUICK_FALSE:
+      result = machine.false;
+      break;
+    case QUICK_TRUE:
+      result = machine.true;
+      break;
+    case QUICK_CONST:
+      result = getPtr(getPtr(machine.newMethod, LITERALS_IN_METHOD), index);
+      break;
+    case QUICK_INST:
+      result = getPtr(receiver, index);
+      break;
+    case QUICK_STORE:
+      setPtr(receiver, index, argument);
+      result = receiver;
+      break;
+    case QUICK_STORERET:
+      setPtr(receiver, index, argument);
+      result = argument;
+      break;
+    default:
+      sysError("illegal quick method 0x%04X", quick);
+      /* never reached */
+      result = machine.nil;
+      break;
+  }
+  while (argSize-- >= 0) {
+    pop();
+  }
+  push(result);
+}
+
+
+static void executeNewMethod(void) {
+  int stackSize;
+  int argSize;
+  int tempSize;
+  ObjPtr quick;
+  ObjPtr primNum;
+
+  argSize =
+    getShortInteger(getPtr(machine.newMethod, ARGSIZE_IN_METHOD));
+  /* a quick method is executed in place */
+  quick = getPtr(machine.newMethod, QUICK_IN_METHOD);
+  if (quick != machine.nil && !debugMachine) {
+    quickMethods++;
+    executeQuick(getShortInteger(quick), argSize);
+    machine.newMethod = machine.nil;
+    return;
+  }
+  /* a primitive method works on the stack of the sender */
+  primNum = getPtr(machine.newMethod, PRIMITIVE_IN_METHOD);
+  if (primNum != machine.nil && !debugMachine) {
+    machine.newMethod = machine.nil;
+    primitiveMethods++;
+    primitive(argSize + 1, getShortInteger(primNum));
+    return;
+  }
+  stackSize =
+    getShortInteger(getPtr(machine.newMethod, STACKSIZE_IN_METHOD));
+  tempSize =
+    getShortInteger(getPtr(machine.newMethod, TEMPSIZE_IN_METHOD));
+  /* construct new context, preferably in the stack zone */
+  if (!debugMachine &&
+      stackEnd - stackTop >= FRAME_LENGTH(argSize, tempSize, stackSize)) {
+    createStackContext(argSize, tempSize, stackSize);
+  } else {
+    createHeapContext(argSize, tempSize, stackSize);
+  }
   machine.newMethod = machine.nil;
   /* make the new context the current context */
   activateContext(machine.newContext);
@@ -720,19 +1171,156 @@ static void executeNewMethod(void) {
 }
 
 
-void run(void) {
+/*
+ * Counted loops keep their counter, limit and step as small
+ * integers in three consecutive temporaries (see code.c).
+ * prepareLoop takes the receiver and the limit from the stack
+ * and only succeeds if the counter cannot overflow while it
+ * runs from the receiver to the limit.
+ */
+
+
+static Bool prepareLoop(int counter) {
+  ObjPtr start, limit, step;
+  long end;
+
+  start = getPtr(machine.currentStack, machine.sp - 2);
+  limit = getPtr(machine.currentStack, machine.sp - 1);
+  step = getPtr(machine.currentTemps, counter + 2);
+  if (!(start & IS_SHORTINT) ||
+      !(limit & IS_SHORTINT) ||
+      !(step & IS_SHORTINT) ||
+      getShortInteger(step) == 0) {
+    return false;
+  }
+  end = getShortInteger(limit) + getShortInteger(step);
+  if (end < SHORTINT_MIN || end > SHORTINT_MAX) {
+    return false;
+  }
+  setPtr(machine.currentTemps, counter, start);
+  setPtr(machine.currentTemps, counter + 1, limit);
+  pop();
+  return true;
+}
+
+
+static inline Bool loopFinished(int counter, long value) {
+  long limit, step;
+
+  limit = getShortInteger(fastGetPtr(machine.currentTemps, counter + 1));
+  step = getShortInteger(fastGetPtr(machine.currentTemps, counter + 2));
+  return step > 0 ? value > limit : value < limit;
+}
+
+
+static inline Bool stepLoop(int counter) {
+  long value;
+
+  value = getShortInteger(fastGetPtr(machine.currentTemps, counter)) +
+          getShortInteger(fastGetPtr(machine.currentTemps, counter + 2));
+  fastSetPtr(machine.currentTemps, counter, newShortInteger(value));
+  return !loopFinished(counter, value);
+}
+
+
+/*
+ * The special selectors are executed without a send if both
+ * operands are small integers and so is the result; == and ~~
+ * are never sent. Otherwise, e.g. on overflow or on division
+ * by zero, the message is sent as usual.
+ */
+
+
+static inline Bool sendSpecial(int special,
+                               ObjPtr receiver,
+                               ObjPtr argument,
+                               ObjPtr *result) {
+  long op1, op2, value;
+
+  if (special == SPECIAL_EQEQ) {
+    *result = receiver == argument ? machine.true : machine.false;
+    return true;
+  }
+  if (special == SPECIAL_NOTEQEQ) {
+    *result = receiver != argument ? machine.true : machine.false;
+    return true;
+  }
+  if (!(receiver & IS_SHORTINT) || !(argument & IS_SHORTINT)) {
+    return false;
+  }
+  /* the tagged values compare like the integers they stand */
+  /* for, and only division needs the integers themselves */
+  switch (special) {
+    case SPECIAL_ADD:
+      return addShortIntegers(receiver, argument, result);
+    case SPECIAL_SUB:
+      return subtractShortIntegers(receiver, argument, result);
+    case SPECIAL_MUL:
+      return multiplyShortIntegers(receiver, argument, result);
+    case SPECIAL_DIV:
+      op1 = getShortInteger(receiver);
+      op2 = getShortInteger(argument);
+      if (op2 == 0) {
+        return false;
+      }
+      value = op1 / op2;
+      if (value > SHORTINT_MAX) {
+        return false;
+      }
+      *result = newShortInteger(value);
+      return true;
+    case SPECIAL_MOD:
+      op1 = getShortInteger(receiver);
+      op2 = getShortInteger(argument);
+      if (op2 == 0) {
+        return false;
+      }
+      *result = newShortInteger(op1 % op2);
+      return true;
+    case SPECIAL_LT:
+      *result = (long) receiver < (long) argument ?
+                  machine.true : machine.false;
+      return true;
+    case SPECIAL_LE:
+      *result = (long) receiver <= (long) argument ?
+                  machine.true : machine.false;
+      return true;
+    case SPECIAL_GT:
+      *result = (long) receiver > (long) argument ?
+                  machine.true : machine.false;
+      return true;
+    case SPECIAL_GE:
+      *result = (long) receiver >= (long) argument ?
+                  machine.true : machine.false;
+      return true;
+    case SPECIAL_EQ:
+      *result = receiver == argument ? machine.true : machine.false;
+      return true;
+    case SPECIAL_BITAND:
+      *result = receiver & argument;
+      return true;
+    case SPECIAL_BITOR:
+      *result = receiver | argument;
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+static void runChecked(void) {
   Word instr;
   Word opcode, operand1, operand2;
   ObjPtr selector;
   ObjPtr class;
-  ObjPtr caller;
   ObjPtr retObj;
 
-  while (runMachine) {
-    /* test if debugging mode is on */
-    if (debugMachine) {
-      debug();
-    }
+  /* the debugger shows contexts in the heap only */
+  materializeAll();
+  while (runMachine && debugMachine) {
+    /* debugging mode is on, so this is the place to step */
+    saveContext();
+    debug();
     /* test run flag here again because debug() may have switched it off */
     if (!runMachine) {
       break;
@@ -740,9 +1328,6 @@ void run(void) {
     /* now fetch and execute the next instruction */
     instr = getWord(machine.currentCode, machine.ip);
     machine.ip++;
-    setPtr(machine.currentActiveContext,
-           IP_IN_CONTEXT,
-           newShortInteger(machine.ip));
     opcode = (instr >> 24) & 0xFF;
     operand1 = (instr >> 16) & 0xFF;
     operand2 = instr & 0xFFFF;
@@ -776,22 +1361,10 @@ void run(void) {
         break;
       case OP_RETMSG:
         /* return top of stack from message */
-        /* get context to which we should return */
-        caller =
-          getPtr(machine.currentHomeContext, CALLER_IN_METHODCONTEXT);
-        /* check that we do not try to return from a
-           context that we have already returned from */
-        if (caller == machine.nil) {
-          sysError("cannot return");
-        }
-        /* set flag that we cannot return again */
-        setPtr(machine.currentHomeContext,
-               CALLER_IN_METHODCONTEXT,
-               machine.nil);
         /* get object which should be returned */
         retObj = pop();
         /* change contexts */
-        activateContext(caller);
+        returnFromMethod();
         /* push returned object on stack */
         push(retObj);
         if (debugMachine) {
@@ -802,13 +1375,10 @@ void run(void) {
         break;
       case OP_RETBLK:
         /* return top of stack from block */
-        /* get context to which we should return */
-        caller =
-          getPtr(machine.currentActiveContext, CALLER_IN_BLOCKCONTEXT);
         /* get object which should be returned */
         retObj = pop();
         /* change contexts */
-        activateContext(caller);
+        returnFromBlock();
         /* push returned object on stack */
         push(retObj);
         if (debugMachine) {
@@ -858,6 +1428,21 @@ void run(void) {
         push(machine.newContext);
         machine.newContext = machine.nil;
         break;
+      case OP_SENDSPECIAL:
+        /* send special selector */
+        if (sendSpecial(operand1,
+                        getPtr(machine.currentStack, machine.sp - 2),
+                        getPtr(machine.currentStack, machine.sp - 1),
+                        &retObj)) {
+          pop();
+          pop();
+          push(retObj);
+          break;
+        }
+        /* otherwise send the message, which has one argument */
+        opcode = OP_SEND;
+        operand1 = 1;
+        /* fall through */
       case OP_SEND:
       case OP_SENDSUPER:
         /* send message */
@@ -873,7 +1458,7 @@ void run(void) {
           class = getPtr(getPtr(machine.currentMethod, CLASS_IN_METHOD),
                          SUPERCLASS_IN_CLASS);
         }
-        machine.newMethod = findMethod(class, selector);
+        machine.newMethod = lookupMethod(class, selector);
         if (debugMachine) {
           showWhere(class,
                     getPtr(machine.newMethod, CLASS_IN_METHOD),
@@ -898,9 +1483,53 @@ void run(void) {
       case OP_JUMP:
         /* jump */
         machine.ip = operand2;
-        setPtr(machine.currentActiveContext,
-               IP_IN_CONTEXT,
-               newShortInteger(machine.ip));
+        break;
+      case OP_JUMPTRUE:
+        /* jump if true */
+        retObj = getPtr(machine.currentStack, machine.sp - 1);
+        if (retObj == machine.true) {
+          pop();
+          machine.ip = operand2;
+        } else
+        if (retObj == machine.false) {
+          pop();
+          machine.ip++;
+        }
+        /* otherwise the next instruction sends the message */
+        break;
+      case OP_JUMPFALSE:
+        /* jump if false */
+        retObj = getPtr(machine.currentStack, machine.sp - 1);
+        if (retObj == machine.false) {
+          pop();
+          machine.ip = operand2;
+        } else
+        if (retObj == machine.true) {
+          pop();
+          machine.ip++;
+        }
+        /* otherwise the next instruction sends the message */
+        break;
+      case OP_FORPREP:
+        /* prepare counted loop */
+        if (prepareLoop(operand1)) {
+          machine.ip = operand2;
+        }
+        /* otherwise the next instructions send the message */
+        break;
+      case OP_FORTEST:
+        /* test counted loop */
+        if (loopFinished(operand1,
+                         getShortInteger(getPtr(machine.currentTemps,
+                                                operand1)))) {
+          machine.ip = operand2;
+        }
+        break;
+      case OP_FORSTEP:
+        /* step counted loop */
+        if (stepLoop(operand1)) {
+          machine.ip = operand2;
+        }
         break;
       default:
         /* unknown opcode */
@@ -909,3 +1538,670 @@ void run(void) {
     }
   }
 }
+
+
+/**************************************************************/
+
+/* threaded interpreter */
+
+
+/*
+ * The threaded interpreter does not execute the code arrays of
+ * methods directly. Instead, each code array is decoded once into
+ * a C array of instructions, which hold the address of the code
+ * which implements the instruction (a label in runThreaded) as
+ * well as the already extracted operands. These decoded copies
+ * are kept in a hash table keyed by the address of the code array.
+ * Since code arrays move during garbage collections, the table is
+ * re-keyed after every collection, and entries of code arrays which
+ * did not survive are released. Code arrays are never modified once
+ * the compiler has filled them, so the copies never become stale.
+ *
+ * Every decoded send instruction also gets a send site cache, which
+ * remembers the receiver classes seen at this site together with the
+ * methods found for them. The first entry makes monomorphic sites
+ * cheap, further entries cover polymorphic sites. A site which sees
+ * more classes than the cache can hold is megamorphic; it keeps its
+ * entries but consults the global method cache for all other classes.
+ * Send site caches are reset lazily when the global cache is flushed.
+ * When the methods for a single selector change, only the entries
+ * for that selector are dropped, from the global cache as well as
+ * from the send sites which send it.
+ */
+
+
+#define DECODED_BUCKETS		1024
+#define SEND_CACHE_SIZE		8
+
+
+typedef struct {
+  unsigned long epoch;		/* flush count of global method cache */
+  ObjPtr selector;		/* selector sent at this site */
+  int count;			/* number of valid entries */
+  Bool megamorphic;		/* true if the site overflowed */
+  ObjPtr classes[SEND_CACHE_SIZE];	/* receiver classes seen */
+  ObjPtr methods[SEND_CACHE_SIZE];	/* methods found for them */
+} SendCache;
+
+typedef struct {
+  void *handler;		/* address of instruction implementation */
+  Word operand1;		/* first operand, or opcode if illegal */
+  Word operand2;		/* second operand */
+  SendCache *cache;		/* send site cache, sends only */
+} Instr;
+
+typedef struct decoded {
+  ObjPtr code;			/* the code array which was decoded */
+  int size;			/* number of instructions */
+  Instr *instrs;		/* the decoded instructions */
+  struct decoded *next;		/* next entry in the same bucket */
+} Decoded;
+
+
+static Decoded *decodedTable[DECODED_BUCKETS];
+static void **handlerTable;	/* handler addresses, indexed by opcode */
+static void *illegalHandler;	/* handler address of illegal opcodes */
+
+static unsigned long sendCacheHits = 0;
+static unsigned long sendCachePolyHits = 0;
+static unsigned long sendCacheMisses = 0;
+static unsigned long megamorphicSites = 0;
+
+
+static int decodedBucket(ObjPtr code) {
+  return (code / ALIGN) % DECODED_BUCKETS;
+}
+
+
+static void decode(Decoded *entry) {
+  int size, i;
+  Instr *instrs;
+  Word instr;
+  Word opcode;
+
+  size = getSize(entry->code);
+  instrs = allocate(size * sizeof(Instr));
+  for (i = 0; i < size; i++) {
+    instr = getWord(entry->code, i);
+    opcode = (instr >> 24) & 0xFF;
+    instrs[i].handler = handlerTable[opcode];
+    instrs[i].operand1 = (instr >> 16) & 0xFF;
+    instrs[i].operand2 = instr & 0xFFFF;
+    instrs[i].cache = NULL;
+    if (instrs[i].handler == illegalHandler) {
+      instrs[i].operand1 = opcode;
+    }
+    if (opcode == OP_SEND ||
+        opcode == OP_SENDSUPER ||
+        opcode == OP_SENDSPECIAL) {
+      instrs[i].cache = allocate(sizeof(SendCache));
+      instrs[i].cache->epoch = methodCacheEpoch;
+      instrs[i].cache->selector = machine.nil;
+      instrs[i].cache->count = 0;
+      instrs[i].cache->megamorphic = false;
+    }
+  }
+  entry->size = size;
+  entry->instrs = instrs;
+}
+
+
+static void releaseDecoded(Decoded *entry) {
+  int i;
+
+  for (i = 0; i < entry->size; i++) {
+    if (entry->instrs[i].cache != NULL) {
+      release(entry->instrs[i].cache);
+    }
+  }
+  release(entry->instrs);
+  release(entry);
+}
+
+
+static void relocateSendCache(SendCache *cache) {
+  int i;
+
+  cache->selector = survivor(cache->selector);
+  for (i = 0; i < cache->count; i++) {
+    cache->classes[i] = survivor(cache->classes[i]);
+    cache->methods[i] = survivor(cache->methods[i]);
+    if (cache->classes[i] == machine.nil ||
+        cache->methods[i] == machine.nil) {
+      /* something died, simply start afresh */
+      cache->count = 0;
+      cache->megamorphic = false;
+      return;
+    }
+  }
+}
+
+
+static Instr *decodedCode(ObjPtr code) {
+  int bucket;
+  Decoded *entry;
+
+  bucket = decodedBucket(code);
+  for (entry = decodedTable[bucket]; entry != NULL; entry = entry->next) {
+    if (entry->code == code) {
+      return entry->instrs;
+    }
+  }
+  entry = allocate(sizeof(Decoded));
+  entry->code = code;
+  decode(entry);
+  entry->next = decodedTable[bucket];
+  decodedTable[bucket] = entry;
+  return entry->instrs;
+}
+
+
+static void relocateDecoded(void) {
+  Decoded *survivors;
+  Decoded *entry, *next;
+  int bucket;
+  int i;
+
+  /* collect the entries of surviving code arrays, release the rest */
+  survivors = NULL;
+  for (bucket = 0; bucket < DECODED_BUCKETS; bucket++) {
+    for (entry = decodedTable[bucket]; entry != NULL; entry = next) {
+      next = entry->next;
+      entry->code = survivor(entry->code);
+      if (entry->code == machine.nil) {
+        releaseDecoded(entry);
+      } else {
+        for (i = 0; i < entry->size; i++) {
+          if (entry->instrs[i].cache != NULL) {
+            relocateSendCache(entry->instrs[i].cache);
+          }
+        }
+        entry->next = survivors;
+        survivors = entry;
+      }
+    }
+    decodedTable[bucket] = NULL;
+  }
+  /* then enter them again under their new addresses */
+  for (entry = survivors; entry != NULL; entry = next) {
+    next = entry->next;
+    bucket = decodedBucket(entry->code);
+    entry->next = decodedTable[bucket];
+    decodedTable[bucket] = entry;
+  }
+}
+
+
+void flushSelector(ObjPtr selector) {
+  MethodCacheEntry *entry;
+  Decoded *decoded;
+  SendCache *cache;
+  int bucket;
+  int i;
+
+  /* drop the global cache entries for this selector */
+  for (i = 0; i < METHOD_CACHE_SIZE; i++) {
+    entry = &methodCache[i];
+    if (entry->selector == selector) {
+      entry->class = machine.nil;
+      entry->selector = machine.nil;
+      entry->method = machine.nil;
+    }
+  }
+  /* and reset the send sites which send it */
+  for (bucket = 0; bucket < DECODED_BUCKETS; bucket++) {
+    for (decoded = decodedTable[bucket];
+         decoded != NULL;
+         decoded = decoded->next) {
+      for (i = 0; i < decoded->size; i++) {
+        cache = decoded->instrs[i].cache;
+        if (cache != NULL && cache->selector == selector) {
+          cache->count = 0;
+          cache->megamorphic = false;
+        }
+      }
+    }
+  }
+  selectorFlushes++;
+}
+
+
+static inline ObjPtr sendSiteLookup(SendCache *cache,
+                                    ObjPtr class, ObjPtr selector) {
+  ObjPtr method;
+  int i;
+
+  if (cache->epoch != methodCacheEpoch) {
+    /* methods have changed since the entries were made */
+    cache->epoch = methodCacheEpoch;
+    cache->count = 0;
+    cache->megamorphic = false;
+  }
+  if (cache->count != 0 && cache->classes[0] == class) {
+    sendCacheHits++;
+    return cache->methods[0];
+  }
+  for (i = 1; i < cache->count; i++) {
+    if (cache->classes[i] == class) {
+      sendCachePolyHits++;
+      return cache->methods[i];
+    }
+  }
+  sendCacheMisses++;
+  method = lookupMethod(class, selector);
+  cache->selector = selector;
+  if (cache->count < SEND_CACHE_SIZE) {
+    cache->classes[cache->count] = class;
+    cache->methods[cache->count] = method;
+    cache->count++;
+  } else
+  if (!cache->megamorphic) {
+    cache->megamorphic = true;
+    megamorphicSites++;
+  }
+  return method;
+}
+
+
+static inline void fastPush(ObjPtr object) {
+  fastSetPtr(machine.currentStack, machine.sp, object);
+  machine.sp++;
+}
+
+
+static inline ObjPtr fastPop(void) {
+  ObjPtr object;
+
+  machine.sp--;
+  object = fastGetPtr(machine.currentStack, machine.sp);
+  fastSetPtr(machine.currentStack,
+             machine.sp,
+             machine.nil);
+  return object;
+}
+
+
+static inline ObjPtr fastGetClass(ObjPtr object) {
+  if (object & IS_SHORTINT) {
+    return machine.ShortInteger;
+  }
+  return fastClass(object);
+}
+
+
+/* fetch the next instruction and jump to its implementation */
+#define DISPATCH() \
+  do { \
+    instr = code + machine.ip; \
+    machine.ip++; \
+    goto *instr->handler; \
+  } while (0)
+
+/* find the decoded code again after a context switch or a GC */
+#define RELOAD() \
+  do { \
+    if (machine.currentCode != codeObj) { \
+      codeObj = machine.currentCode; \
+      code = decodedCode(codeObj); \
+    } \
+  } while (0)
+
+/* leave the threaded interpreter if it should not continue */
+#define SAFEPOINT() \
+  do { \
+    if (debugMachine || !runMachine) { \
+      return; \
+    } \
+  } while (0)
+
+
+static void runThreaded(void) {
+  static void *handlers[256] = {
+    [0 ... 255]    = &&illegal,
+    [OP_NOP]       = &&nop,
+    [OP_PUSHSELF]  = &&pushself,
+    [OP_PUSHNIL]   = &&pushnil,
+    [OP_PUSHFALSE] = &&pushfalse,
+    [OP_PUSHTRUE]  = &&pushtrue,
+    [OP_DUP]       = &&dup,
+    [OP_DROP]      = &&drop,
+    [OP_RETMSG]    = &&retmsg,
+    [OP_RETBLK]    = &&retblk,
+    [OP_PUSHCONST] = &&pushconst,
+    [OP_PUSHGLOB]  = &&pushglob,
+    [OP_STOREGLOB] = &&storeglob,
+    [OP_PUSHINST]  = &&pushinst,
+    [OP_STOREINST] = &&storeinst,
+    [OP_PUSHARG]   = &&pusharg,
+    [OP_PUSHTEMP]  = &&pushtemp,
+    [OP_STORETEMP] = &&storetemp,
+    [OP_PUSHBLK]   = &&pushblk,
+    [OP_SEND]      = &&send,
+    [OP_SENDSUPER] = &&sendsuper,
+    [OP_PRIM]      = &&prim,
+    [OP_JUMP]      = &&jump,
+    [OP_JUMPTRUE]  = &&jumptrue,
+    [OP_JUMPFALSE] = &&jumpfalse,
+    [OP_FORPREP]   = &&forprep,
+    [OP_FORTEST]   = &&fortest,
+    [OP_FORSTEP]   = &&forstep,
+    [OP_SENDSPECIAL] = &&sendspecial,
+  };
+  ObjPtr codeObj;
+  Instr *code;
+  Instr *instr;
+  int numArgs;
+  ObjPtr selector;
+  ObjPtr class;
+  ObjPtr receiver;
+  ObjPtr retObj;
+
+  handlerTable = handlers;
+  illegalHandler = &&illegal;
+  codeObj = machine.currentCode;
+  code = decodedCode(codeObj);
+  DISPATCH();
+
+nop:
+  /* no operation */
+  DISPATCH();
+
+pushself:
+  /* push receiver */
+  fastPush(machine.currentReceiver);
+  DISPATCH();
+
+pushnil:
+  /* push nil */
+  fastPush(machine.nil);
+  DISPATCH();
+
+pushfalse:
+  /* push false */
+  fastPush(machine.false);
+  DISPATCH();
+
+pushtrue:
+  /* push true */
+  fastPush(machine.true);
+  DISPATCH();
+
+dup:
+  /* duplicate top of stack */
+  fastPush(fastGetPtr(machine.currentStack, machine.sp - 1));
+  DISPATCH();
+
+drop:
+  /* drop top of stack */
+  fastPop();
+  DISPATCH();
+
+retmsg:
+  /* return top of stack from message */
+  retObj = fastPop();
+  returnFromMethod();
+  fastPush(retObj);
+  RELOAD();
+  DISPATCH();
+
+retblk:
+  /* return top of stack from block */
+  retObj = fastPop();
+  returnFromBlock();
+  fastPush(retObj);
+  RELOAD();
+  DISPATCH();
+
+pushconst:
+  /* push constant */
+  fastPush(fastGetPtr(machine.currentLiterals, instr->operand2));
+  DISPATCH();
+
+pushglob:
+  /* push global */
+  fastPush(fastGetPtr(fastGetPtr(machine.currentLiterals, instr->operand2),
+                      VALUE_IN_LINK));
+  DISPATCH();
+
+storeglob:
+  /* store global */
+  retObj = fastPop();
+  fastSetPtr(fastGetPtr(machine.currentLiterals, instr->operand2),
+             VALUE_IN_LINK,
+             retObj);
+  writeBarrier(fastGetPtr(machine.currentLiterals, instr->operand2),
+               retObj);
+  DISPATCH();
+
+pushinst:
+  /* push instance */
+  fastPush(fastGetPtr(machine.currentReceiver, instr->operand1));
+  DISPATCH();
+
+storeinst:
+  /* store instance */
+  retObj = fastPop();
+  fastSetPtr(machine.currentReceiver, instr->operand1, retObj);
+  writeBarrier(machine.currentReceiver, retObj);
+  DISPATCH();
+
+pusharg:
+  /* push argument */
+  fastPush(fastGetPtr(machine.currentArgs, instr->operand1));
+  DISPATCH();
+
+pushtemp:
+  /* push temporary */
+  fastPush(fastGetPtr(machine.currentTemps, instr->operand1));
+  DISPATCH();
+
+storetemp:
+  /* store temporary */
+  fastSetPtr(machine.currentTemps, instr->operand1, fastPop());
+  DISPATCH();
+
+pushblk:
+  /* push block */
+  createBlockContext(instr->operand1, instr->operand2);
+  fastPush(machine.newContext);
+  machine.newContext = machine.nil;
+  DISPATCH();
+
+send:
+  /* send message, lookup starts in receiver's class */
+  numArgs = instr->operand1;
+  selector = fastGetPtr(machine.currentLiterals, instr->operand2);
+  class = fastGetClass(fastGetPtr(machine.currentStack,
+                                  machine.sp - numArgs - 1));
+  goto execute;
+
+sendsuper:
+  /* send message, lookup starts in superclass of method's class */
+  numArgs = instr->operand1;
+  selector = fastGetPtr(machine.currentLiterals, instr->operand2);
+  class = fastGetPtr(fastGetPtr(machine.currentMethod, CLASS_IN_METHOD),
+                     SUPERCLASS_IN_CLASS);
+  goto execute;
+
+sendspecial:
+  /* send special selector, unless it can be executed right here */
+  receiver = fastGetPtr(machine.currentStack, machine.sp - 2);
+  if (sendSpecial(instr->operand1,
+                  receiver,
+                  fastGetPtr(machine.currentStack, machine.sp - 1),
+                  &retObj)) {
+    machine.sp--;
+    fastSetPtr(machine.currentStack, machine.sp, machine.nil);
+    fastSetPtr(machine.currentStack, machine.sp - 1, retObj);
+    DISPATCH();
+  }
+  numArgs = 1;
+  selector = fastGetPtr(machine.currentLiterals, instr->operand2);
+  class = fastGetClass(receiver);
+  goto execute;
+
+execute:
+  machine.newMethod = sendSiteLookup(instr->cache, class, selector);
+  if (numArgs !=
+      getShortInteger(fastGetPtr(machine.newMethod, ARGSIZE_IN_METHOD))) {
+    sysError("wrong number of arguments in message send");
+  }
+  executeNewMethod();
+  RELOAD();
+  SAFEPOINT();
+  DISPATCH();
+
+prim:
+  /* call primitive */
+  primitive(instr->operand1, instr->operand2);
+  RELOAD();
+  SAFEPOINT();
+  DISPATCH();
+
+jump:
+  /* jump */
+  machine.ip = instr->operand2;
+  SAFEPOINT();
+  DISPATCH();
+
+jumptrue:
+  /* jump if true */
+  retObj = fastGetPtr(machine.currentStack, machine.sp - 1);
+  if (retObj == machine.true) {
+    fastPop();
+    machine.ip = instr->operand2;
+  } else
+  if (retObj == machine.false) {
+    fastPop();
+    machine.ip++;
+  }
+  DISPATCH();
+
+jumpfalse:
+  /* jump if false */
+  retObj = fastGetPtr(machine.currentStack, machine.sp - 1);
+  if (retObj == machine.false) {
+    fastPop();
+    machine.ip = instr->operand2;
+  } else
+  if (retObj == machine.true) {
+    fastPop();
+    machine.ip++;
+  }
+  DISPATCH();
+
+forprep:
+  /* prepare counted loop */
+  if (prepareLoop(instr->operand1)) {
+    machine.ip = instr->operand2;
+  }
+  DISPATCH();
+
+fortest:
+  /* test counted loop */
+  if (loopFinished(instr->operand1,
+                   getShortInteger(fastGetPtr(machine.currentTemps,
+                                              instr->operand1)))) {
+    machine.ip = instr->operand2;
+  }
+  DISPATCH();
+
+forstep:
+  /* step counted loop */
+  if (stepLoop(instr->operand1)) {
+    machine.ip = instr->operand2;
+    SAFEPOINT();
+  }
+  DISPATCH();
+
+illegal:
+  /* unknown opcode */
+  sysError("illegal opcode 0x%02X encountered", instr->operand1);
+}
+
+
+/**************************************************************/
+
+/* caches and statistics */
+
+
+void relocateCaches(void) {
+  relocateMethodCache();
+  relocateDecoded();
+}
+
+
+void showStatistics(void) {
+  int monomorphic, polymorphic, megamorphic;
+  Decoded *entry;
+  int bucket, i;
+  SendCache *cache;
+
+  /* classify the send sites which are cached right now */
+  monomorphic = 0;
+  polymorphic = 0;
+  megamorphic = 0;
+  for (bucket = 0; bucket < DECODED_BUCKETS; bucket++) {
+    for (entry = decodedTable[bucket]; entry != NULL; entry = entry->next) {
+      for (i = 0; i < entry->size; i++) {
+        cache = entry->instrs[i].cache;
+        if (cache == NULL || cache->count == 0) {
+          continue;
+        }
+        if (cache->megamorphic) {
+          megamorphic++;
+        } else
+        if (cache->count > 1) {
+          polymorphic++;
+        } else {
+          monomorphic++;
+        }
+      }
+    }
+  }
+  printf("VM statistics:\n");
+  printf("    method cache: %lu hits, %lu misses, %lu flushes, "
+         "%lu selector flushes\n",
+         methodCacheHits, methodCacheMisses, methodCacheFlushes,
+         selectorFlushes);
+  printf("    send site caches: %lu monomorphic hits, "
+         "%lu polymorphic hits, %lu misses\n",
+         sendCacheHits, sendCachePolyHits, sendCacheMisses);
+  printf("    send sites: %d monomorphic, %d polymorphic, "
+         "%d megamorphic (%lu became megamorphic)\n",
+         monomorphic, polymorphic, megamorphic, megamorphicSites);
+  printf("    method contexts: %lu in stack zone, %lu in heap, "
+         "%lu moved to heap\n",
+         stackContexts, heapContexts, movedContexts);
+  printf("    methods without a context: %lu quick, %lu primitive\n",
+         quickMethods, primitiveMethods);
+}
+
+
+/**************************************************************/
+
+/* interpreter selection */
+
+
+void run(void) {
+  /* the checked interpreter is used while debugging; the */
+  /* threaded interpreter returns whenever debugging mode */
+  /* is switched on, and the checked interpreter returns */
+  /* as soon as it is switched off again */
+  while (runMachine) {
+    if (debugMachine) {
+      runChecked();
+    } else {
+      runThreaded();
+    }
+  }
+  completeContexts();
+}
+
+
+void completeContexts(void) {
+  /* the image may be saved now, so move all contexts */
+  /* into the heap and complete the active context */
+  materializeAll();
+  saveContext();
+}
@@ -10,17 +10,17 @@
 #define SIGNATURE_1	0x37A2F90B
 #define SIGNATURE_2	0x1E84C56D
 
+#define IMAGE_FORMAT	6	/* changes whenever the object layout does */
+#define IMAGE_ALIGN	(64 * K)	/* object memory starts at a multiple
+				   of this in the file, so it can be mapped */
+
 
 typedef struct {
-  /* image file signature */
-  Word signature_1;		/* must be SIGNATURE_1 */
-  Word signature_2;		/* must be SIGNATURE_2 */
-  /* image file version number */
-  int majorVersion;		/* same as main program's major version */
-  int minorVersion;		/* main's minor version, is not checked */
   /* image file structure */
   long memoryStart;		/* byte offset of object memory in file */
   long memorySize;		/* total size of object memory in bytes */
+  long compressedSize;		/* size of object memory in file if it
+				   is compressed, 0 otherwise */
   /* known objects */
   ObjPtr nil;			/* the single instance of UndefinedObject */
   ObjPtr false;			/* the single instance of False */
@@ -30,6 +30,8 @@ typedef struct {
   /* known classes */
   ObjPtr ShortInteger;		/* class object of class ShortInteger */
   ObjPtr Float;			/* class object of class Float */
+  ObjPtr LargePositiveInteger;	/* class object of class LargePositiveInteger */
+  ObjPtr LargeNegativeInteger;	/* class object of class LargeNegativeInteger */
   ObjPtr Character;		/* class object of class Character */
   ObjPtr String;		/* class object of class String */
   ObjPtr Symbol;		/* class object of class Symbol */
@@ -83,17 +85,57 @@ typedef struct {
 #define OP_SENDSUPER	0x13	/* send message to super: numargs,selector */
 #define OP_PRIM		0x14	/* call primitive: numargs,primnum */
 #define OP_JUMP		0x15	/* jump: -,target */
+#define OP_JUMPTRUE	0x16	/* jump if true: -,target */
+#define OP_JUMPFALSE	0x17	/* jump if false: -,target */
+#define OP_FORPREP	0x18	/* prepare counted loop: tempnum,target */
+#define OP_FORTEST	0x19	/* test counted loop: tempnum,target */
+#define OP_FORSTEP	0x1A	/* step counted loop: tempnum,target */
+#define OP_SENDSPECIAL	0x1B	/* send special selector: specialnum,selector */
+
+#define SPECIAL_ADD	0	/* + */
+#define SPECIAL_SUB	1	/* - */
+#define SPECIAL_MUL	2	/* * */
+#define SPECIAL_DIV	3	/* // */
+#define SPECIAL_MOD	4	/* \\ */
+#define SPECIAL_LT	5	/* < */
+#define SPECIAL_LE	6	/* <= */
+#define SPECIAL_GT	7	/* > */
+#define SPECIAL_GE	8	/* >= */
+#define SPECIAL_EQ	9	/* = */
+#define SPECIAL_EQEQ	10	/* == */
+#define SPECIAL_NOTEQEQ	11	/* ~~ */
+#define SPECIAL_BITAND	12	/* bitAnd: */
+#define SPECIAL_BITOR	13	/* bitOr: */
+#define NUM_SPECIALS	14
+
+/* quick methods are encoded as kind | index << 8 */
+#define QUICK_SELF	0	/* ^self */
+#define QUICK_NIL	1	/* ^nil */
+#define QUICK_FALSE	2	/* ^false */
+#define QUICK_TRUE	3	/* ^true */
+#define QUICK_CONST	4	/* ^literal: constnum */
+#define QUICK_INST	5	/* ^instVar: instnum */
+#define QUICK_STORE	6	/* instVar <- arg: instnum */
+#define QUICK_STORERET	7	/* ^instVar <- arg: instnum */
 
 
 extern Machine machine;		/* an instance of the virtual machine */
-extern Bool debugMachine;	/* operate VM in debug mode if set */
+extern Bool debugMachine;	/* operate VM in debug mode if set,
+				   i.e. use the checked interpreter */
 extern Bool runMachine;		/* while true, run the machine */
+extern Bool statsMachine;	/* count VM events and show them at exit */
 
 
 void showString(ObjPtr stringObj);
 void push(ObjPtr object);
 ObjPtr pop(void);
+void saveContext(void);
 void activateContext(ObjPtr context);
+void flushMethodCache(void);
+void flushSelector(ObjPtr selector);
+void relocateCaches(void);
+void completeContexts(void);
+void showStatistics(void);
 void run(void);
 
 
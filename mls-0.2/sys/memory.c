@@ -5,13 +5,23 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "common.h"
 #include "utils.h"
 #include "machine.h"
 #include "objects.h"
 #include "memory.h"
+#include "compress.h"
 #include "ui.h"
 
 
@@ -20,11 +30,21 @@
 /* macros */
 
 
-/* three flags are coded in the size field of every object */
+/* the second word of the header codes five flags, the hash, */
+/* which is zero until it is assigned, and the size; a size */
+/* which does not fit into its bits is kept in a word pair */
+/* in front of the header, the second word of which has all */
+/* size bits set, so that the heap can be scanned */
 
 #define BROKEN_HEART		WORD_MSB
 #define HAS_POINTERS		WORD_NSB
 #define HAS_WORDS		WORD_TSB
+#define REMEMBERED		(WORD_TSB >> 1)
+#define MARKED			(WORD_TSB >> 2)
+
+#define HASH_SHIFT		12
+#define SIZE_MASK		((1 << HASH_SHIFT) - 1)
+#define SIZE_OVERFLOW		SIZE_MASK
 
 
 /* macros to read and write data in memory */
@@ -37,14 +57,15 @@
 #define writeObjPtr(x, y)	(*(ObjPtr *)(memory + (x)) = (y))
 
 
-/* macros to read and write class and size fields of objects */
+/* macros to read and write class and info fields of objects */
 
-#define readClass(o)	    readObjPtr(o)
-#define writeClass(o, c)    writeObjPtr(o, c)
-#define readHash(o)	    readWord((o) + sizeof(ObjPtr))
-#define writeHash(o, s)	    writeWord((o) + sizeof(ObjPtr), s)
-#define readSize(o)	    readWord((o) + sizeof(ObjPtr) + sizeof(Word))
-#define writeSize(o, s)	    writeWord((o) + sizeof(ObjPtr) + sizeof(Word), s)
+#define readClass(o)	    ((ObjPtr) readWord(o))
+#define writeClass(o, c)    writeWord(o, (Word) (c))
+#define readInfo(o)	    readWord((o) + sizeof(Word))
+#define writeInfo(o, f)    writeWord((o) + sizeof(Word), f)
+#define isLarge(o)	    ((readInfo(o) & SIZE_MASK) == SIZE_OVERFLOW)
+#define readSize(o)	    (isLarge(o) ? readWord((o) - HEADER_SIZE) : \
+				     readInfo(o) & SIZE_MASK)
 
 
 /**************************************************************/
@@ -54,8 +75,16 @@
 
 Bool debugMemory = false;	/* debug flag, give statistics if set */
 Bool enableGC = false;		/* enables garbage collections if set */
+Word heapSize = SEMI_SIZE;	/* initial and minimal size of a semispace */
+Word nurserySize = NURSERY_SIZE;	/* size of the nursery */
+Word gcPauseMicros = 0;		/* pause target of incremental collections,
+				   0 if collections are done at once */
+Bool gcCycle = false;		/* true while an incremental collection
+				   is in progress */
+Bool compressImage = false;	/* write the image compressed if set */
 
-static Byte *memory;		/* object memory where all objects live */
+Byte *memory;			/* object memory where all objects live */
+static Address semiSize;	/* current size of a single semispace */
 
 static Address toStart;		/* base of "to" semispace in memory */
 static Address toEnd;		/* top of "to" semispace in memory */
@@ -64,10 +93,80 @@ static Address fromEnd;		/* top of "from" semispace in memory */
 static Address toFree;		/* address of first free byte in memory,
 				   is always located in "to" semispace */
 
+Address stackStart;		/* base of stack zone in memory */
+Address stackEnd;		/* top of stack zone in memory */
+Address stackTop;		/* address of first free byte in stack zone */
+
+Address permStart;		/* base of permanent space in memory */
+Address permEnd;		/* top of permanent space in memory */
+
+Address nurseryStart;		/* base of nursery in memory */
+Address nurseryEnd;		/* top of nursery in memory */
+static Address nurseryFree;	/* address of first free byte in nursery */
+
+Address largeStart;		/* base of large-object space in memory */
+Address largeEnd;		/* top of large-object space in memory */
+
+typedef struct {
+  Address start;		/* first byte of a free chunk */
+  Address length;		/* length of the chunk in bytes */
+} Chunk;
+
+static Chunk *freeChunks;	/* free chunks in large-object space */
+static int numFreeChunks;	/* number of free chunks */
+static int maxFreeChunks;	/* capacity of the free chunk list */
+static ObjPtr *largeObjects;	/* objects in large-object space */
+static int numLargeObjects;	/* number of large objects */
+static int maxLargeObjects;	/* capacity of both large object lists */
+static ObjPtr *markedObjects;	/* large objects marked by a collection */
+static int numMarked;		/* number of marked large objects */
+static Address largeUsed;	/* bytes taken by large objects */
+static Address largeLimit;	/* do a major collection above this */
+static Address pageSize;	/* granularity of the large-object space */
+static Bool imageMapped;	/* true if the permanent space is mapped
+				   from the image file */
+static Bool imageConverted;	/* true if the image had another layout */
+static char *imageName;		/* name of the image file */
+static pid_t snapshotPid;	/* process writing a snapshot, or 0 */
+static int lastSnapshot;	/* status of the last finished snapshot */
+
+static ObjPtr *remembered;	/* old objects which may point to young ones */
+static int numRemembered;	/* number of remembered objects */
+static int maxRemembered;	/* capacity of the remembered set */
+
+static Bool majorGC;		/* true while and after a major collection */
+static Bool collectPerm;	/* true while permanent objects are moved */
+static ObjPtr allocClass;	/* class of an object being allocated */
+
 static Word numBytes;		/* number of bytes allocated since last GC,
 				   also number of bytes copied during GC */
 static Word numObjects;		/* number of objects allocated since last GC,
 				   also number of objects copied during GC */
+static unsigned long numCollections;	/* number of collections done */
+static double totalBytes;	/* number of bytes copied by all of them */
+static double totalSeconds;	/* time spent in all of them */
+
+static Address cycleScan;	/* next object to be scanned by the
+				   increments of a collection */
+static int cycleLargeScan;	/* next marked large object to be scanned */
+static Word cycleLargeField;	/* next field of that object to be scanned */
+static Chunk *promotedRuns;	/* objects promoted during the collection,
+				   which need not be scanned by it */
+static int numPromotedRuns;	/* number of such runs of objects */
+static int maxPromotedRuns;	/* capacity of the list of runs */
+static int nextPromotedRun;	/* next run to be skipped */
+static Address cycleFromUsed;	/* bytes in the "from" semispace */
+static Address cyclePromoted;	/* bytes promoted during the collection */
+static Bool resizeDue;		/* an incremental collection has ended */
+static unsigned long numCycles;	/* number of incremental collections */
+static unsigned long numFinished;	/* number of those finished at once */
+
+#define PAUSE_BUCKETS	32	/* pause i takes below 2^i microseconds */
+
+static unsigned long pauseCounts[PAUSE_BUCKETS];	/* pause histogram */
+static unsigned long numPauses;	/* number of pauses for collections */
+static double totalPauses;	/* their total length in seconds */
+static double longestPause;	/* the longest one in seconds */
 
 
 /**************************************************************/
@@ -75,27 +174,120 @@ static Word numObjects;		/* number of objects allocated since last GC,
 /* garbage collector */
 
 
-static ObjPtr copyObject(ObjPtr object) {
-  Word length;
-  ObjPtr copy;
-  Address body;
+/* room for all objects of the nursery is kept free at the top */
+/* of the old space, so that a major collection never overflows */
 
-  /* REMARK: short integers are provably never copied */
-  /* read size of object */
+#define OLD_END		(toEnd - (Address) nurserySize)
+
+
+/* memory is reserved once for all spaces, up to the offsets */
+/* that still fit into a word, since class pointers are kept */
+/* there; pages are only taken from the system when touched */
+
+#define MEMORY_LIMIT	((Address) (Word) -1 + 1)
+
+
+/*
+ * The collector is generational. New objects are allocated in the
+ * nursery, except for large ones, which go directly into the "to"
+ * semispace, the old space. A minor collection copies the objects
+ * surviving in the nursery to the end of the old space, so that it
+ * only touches the survivors. Its roots are the machine registers,
+ * the stack zone, and the remembered set: old objects into which a
+ * young object has been stored. The write barrier in setPtr (and
+ * writeBarrier for the threaded interpreter) maintains this set.
+ * The arrays of the active context are always remembered, so that
+ * pushes and stores to temporaries need no barrier. If the old
+ * space cannot take all objects of the nursery, a major collection
+ * copies all living objects, young and old, into the other
+ * semispace, like the original two-space collector did.
+ *
+ * The objects loaded from the image are placed in a permanent space
+ * and never moved by these collections. Permanent objects into which
+ * an object of the semispaces or the nursery has been stored stay
+ * in the remembered set, and are roots of major collections as well.
+ * Only when the image is saved, all objects are collected, and
+ * then moved down to the base of the permanent space, so that the
+ * image is compact and can be loaded there again.
+ *
+ * Large objects live in a large-object space at the top of memory
+ * and are never moved. A major collection marks those which are
+ * reachable and scans them like copied objects; the others are
+ * freed afterwards, and their pages are given back to the system.
+ * The large-object space is taken from a free list of page-sized
+ * chunks, and extended downwards if none fits. Large objects are
+ * old objects as far as the write barrier is concerned. When they
+ * have grown by the size of a semispace since the last major
+ * collection, the next large object starts a major collection,
+ * just as if it had been allocated in the old space. When the image
+ * is saved, large objects are copied like all others.
+ *
+ * With a pause target, major collections are done incrementally.
+ * Such a collection starts when the old space is half full: the
+ * nursery is emptied, the semispaces are flipped, and only the
+ * roots are relocated. After each of the following minor
+ * collections, the copied objects are scanned until the pause
+ * target is reached. Meanwhile, the machine must only see objects
+ * which have been copied or marked, so every pointer it loads from
+ * an object passes a read barrier (see memory.h), which copies or
+ * marks the object first; objects allocated meanwhile can only
+ * point to such objects. Large objects allocated meanwhile are
+ * marked at once. Since the objects still to be copied need room
+ * in the "to" semispace, a collection which would run out of it is
+ * finished at once. The caches of the machine are relocated when
+ * the collection starts, which drops the entries for objects not
+ * copied by then, so that they never show the "from" semispace.
+ *
+ * The stack zone lies at the bottom of memory, followed by the
+ * permanent space, the two semispaces, and the nursery. When a
+ * major collection leaves the old space more than half full, the
+ * semispaces are doubled; when it leaves less than an eighth used,
+ * they are halved, but never below their initial size. The lower
+ * semispace keeps its place when the semispaces are resized, so
+ * the objects are moved there first if necessary.
+ */
+
+
+static inline Address objectLength(ObjPtr object) {
+  Word info;
+  Address length;
+
+  /* compute the length of an object from its header, including */
+  /* header and padding for alignment, but not a size in front */
+  info = readInfo(object);
   length = readSize(object);
-  /* compute length of object dependent on pointer and word flags */
-  if (length & HAS_POINTERS) {
-    length &= ~(HAS_POINTERS | HAS_WORDS);
+  if (info & HAS_POINTERS) {
     length *= sizeof(ObjPtr);
   } else {
-    if (length & HAS_WORDS) {
-      length &= ~HAS_WORDS;
+    if (info & HAS_WORDS) {
       length *= sizeof(Word);
     } else {
       length *= sizeof(Byte);
     }
   }
-  length += sizeof(ObjPtr) + sizeof(Word) + sizeof(Word);
+  return (HEADER_SIZE + length + ALIGN_MASK) & ~ALIGN_MASK;
+}
+
+
+static inline ObjPtr objectAt(Address address) {
+  /* answer the object found at an address while scanning */
+  /* a space, skipping the size in front of a large object */
+  return isLarge(address) ? address + HEADER_SIZE : address;
+}
+
+
+static ObjPtr copyObject(ObjPtr object) {
+  Address start;
+  Address length;
+  ObjPtr copy;
+
+  /* REMARK: short integers are provably never copied */
+  start = object;
+  length = objectLength(object);
+  if (isLarge(object)) {
+    start -= HEADER_SIZE;
+    length += HEADER_SIZE;
+  }
   /* if not enough space, something goes terribly wrong */
   if (toFree + length > toEnd) {
     sysError("copyObject has no space");
@@ -105,41 +297,57 @@ static ObjPtr copyObject(ObjPtr object) {
     numBytes += length;
     numObjects++;
   }
-  /* copy the object to free memory */
-  copy = (ObjPtr) toFree;
-  body = (Address) object;
-  while (length--) {
-    writeByte(toFree, readByte(body));
-    toFree++;
-    body++;
-  }
-  /* satisfy alignment restrictions */
-  while (toFree & ALIGN_MASK) {
-    toFree++;
-  }
+  /* copy the object to free memory, size and padding included */
+  copy = (ObjPtr) toFree + (object - start);
+  memcpy(memory + toFree, memory + start, length);
+  toFree += length;
   /* return new address */
   return copy;
 }
 
 
-static ObjPtr updatePointer(ObjPtr object) {
-  Word size;
+static Bool isCollected(ObjPtr object) {
+  /* a minor collection moves the objects in the nursery, */
+  /* a major one also those in the "from" semispace */
+  if (isYoungObject(object)) {
+    return true;
+  }
+  if (!majorGC) {
+    return false;
+  }
+  if (object >= fromStart && object < fromEnd) {
+    return true;
+  }
+  if (isLargeObject(object)) {
+    return true;
+  }
+  return collectPerm && isPermObject(object);
+}
+
+
+static inline ObjPtr moveObject(ObjPtr object) {
+  Word info;
   ObjPtr copy;
 
-  /* a relocated short integer is the short integer itself */
-  if (object & IS_SHORTINT) {
+  /* large objects stay where they are, unless the image is */
+  /* saved, they only get marked and scanned later */
+  info = readInfo(object);
+  if (isLargeObject(object) && !collectPerm) {
+    if ((info & MARKED) == 0) {
+      writeInfo(object, info | MARKED);
+      markedObjects[numMarked++] = object;
+    }
     return object;
   }
-  /* read size and check the broken-heart flag */
-  size = readSize(object);
-  if (size & BROKEN_HEART) {
+  /* check the broken-heart flag */
+  if (info & BROKEN_HEART) {
     /* object has already been copied, forward pointer is in class slot */
     return readClass(object);
   } else {
     /* object has not been copied yet, so do this now */
     copy = copyObject(object);
     /* in the original object: set broken-heart flag and forward pointer */
-    writeSize(object, size | BROKEN_HEART);
+    writeInfo(object, info | BROKEN_HEART);
     writeClass(object, copy);
     /* return pointer to copied object */
     return copy;
@@ -147,35 +355,728 @@ static ObjPtr updatePointer(ObjPtr object) {
 }
 
 
+static ObjPtr updatePointer(ObjPtr object) {
+  /* a relocated short integer is the short integer itself */
+  if (object & IS_SHORTINT) {
+    return object;
+  }
+  /* objects in the stack zone and old objects during */
+  /* minor collections are not moved */
+  if (!isCollected(object)) {
+    return object;
+  }
+  return moveObject(object);
+}
+
+
 #define UPDATE(reg)	reg = updatePointer(reg)
 
 
-static void doGC(void) {
-  Address tmp;
-  Address toScan;
+/* while scanning copied objects, the objects referenced a few */
+/* fields ahead are fetched into the cache if they must be copied */
+
+#define PREFETCH_DISTANCE	8
+
+#define prefetchObject(o) \
+  do { \
+    if (isCollected(o)) { \
+      __builtin_prefetch(memory + (o)); \
+    } \
+  } while (0)
+
+
+static void updateFields(ObjPtr object, Bool prefetch) {
+  ObjPtr *field;
   Word size;
+  Word i;
+
+  /* relocate class and fields of an object */
+  writeClass(object, updatePointer(readClass(object)));
+  if ((readInfo(object) & HAS_POINTERS) == 0) {
+    return;
+  }
+  size = readSize(object);
+  field = (ObjPtr *) (memory + object + HEADER_SIZE);
+  for (i = 0; i < size; i++) {
+    if (prefetch && i + PREFETCH_DISTANCE < size) {
+      prefetchObject(field[i + PREFETCH_DISTANCE]);
+    }
+    field[i] = updatePointer(field[i]);
+  }
+}
+
+
+/*
+ * With more than one GC thread, the scanning phase of a major
+ * collection is done in parallel. The roots are still relocated
+ * by the main thread; the objects copied so far, and the large
+ * objects marked so far, are then handed over to the workers.
+ * Each worker copies objects into local allocation buffers taken
+ * from the "to" semispace, and keeps the copies still to be
+ * scanned in a work-stealing deque (Chase and Lev): the owner
+ * pushes and pops at the bottom, idle workers steal at the top.
+ * Two workers may copy the same small object at the same time; the
+ * one which installs the forward pointer, by a compare-and-swap of
+ * the whole header, wins, and the other one takes back its copy.
+ * Big objects are claimed the same way before they are copied.
+ * The unused ends of the buffers are filled with dummy objects,
+ * so that the heap can still be scanned linearly. The parallel
+ * phase is only used if the "to" semispace has room for these.
+ */
+
+
+#define LAB_SIZE	(32 * K)	/* size of local allocation buffers */
+#define DEQUE_SIZE	1024		/* initial capacity of a deque */
+
+#define ABORT		((ObjPtr) 1)	/* a steal lost a race */
+
+
+typedef union {
+  unsigned long all;		/* the whole header of an object */
+  Word half[2];			/* class and info word */
+} Header;
+
+typedef struct {
+  ObjPtr *array;		/* elements, indexed modulo capacity */
+  long capacity;		/* always a power of 2 */
+} DequeArray;
+
+typedef struct {
+  long top;			/* next element to be stolen */
+  long bottom;			/* next free slot of the owner */
+  DequeArray *deque;		/* current array of elements */
+  DequeArray *retired[40];	/* arrays replaced while growing */
+  int numRetired;		/* number of retired arrays */
+  Address labFree;		/* first free byte in the buffer */
+  Address labEnd;		/* top of the buffer */
+  Word numBytes;		/* number of bytes copied */
+  Word numObjects;		/* number of objects copied */
+  pthread_t thread;		/* the thread of the worker */
+} Worker;
+
+
+int gcThreads = 1;		/* number of threads used by the GC */
+
+static Worker *workers;		/* the workers of a parallel collection */
+static int numIdle;		/* workers which found nothing to do */
+static Address parallelFree;	/* first free byte for new buffers */
+static Address copyBound;	/* most bytes a collection can copy */
+
+
+static DequeArray *newDequeArray(long capacity) {
+  DequeArray *a;
+
+  a = allocate(sizeof(DequeArray));
+  a->array = allocate(capacity * sizeof(ObjPtr));
+  a->capacity = capacity;
+  return a;
+}
+
+
+static void pushWork(Worker *w, ObjPtr object) {
+  long b, t, i;
+  DequeArray *a;
+  DequeArray *bigger;
+
+  b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+  t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+  a = __atomic_load_n(&w->deque, __ATOMIC_RELAXED);
+  if (b - t >= a->capacity) {
+    /* thieves may still read the old array, so keep it */
+    if (w->numRetired == 40) {
+      sysError("pushWork deque too large");
+    }
+    bigger = newDequeArray(2 * a->capacity);
+    for (i = t; i < b; i++) {
+      bigger->array[i & (bigger->capacity - 1)] =
+        a->array[i & (a->capacity - 1)];
+    }
+    w->retired[w->numRetired++] = a;
+    __atomic_store_n(&w->deque, bigger, __ATOMIC_RELEASE);
+    a = bigger;
+  }
+  a->array[b & (a->capacity - 1)] = object;
+  __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+
+static ObjPtr popWork(Worker *w) {
+  long b, t;
+  DequeArray *a;
+  ObjPtr object;
+
+  /* answer 0 if the deque is empty */
+  b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+  a = __atomic_load_n(&w->deque, __ATOMIC_RELAXED);
+  __atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  t = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+  if (t > b) {
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  object = a->array[b & (a->capacity - 1)];
+  if (t == b) {
+    /* the last element, race against thieves */
+    if (!__atomic_compare_exchange_n(&w->top, &t, t + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      object = 0;
+    }
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return object;
+}
+
+
+static ObjPtr stealWork(Worker *w) {
+  long b, t;
+  DequeArray *a;
+  ObjPtr object;
+
+  /* answer 0 if the deque is empty, ABORT if the race was lost */
+  t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b) {
+    return 0;
+  }
+  a = __atomic_load_n(&w->deque, __ATOMIC_CONSUME);
+  object = a->array[t & (a->capacity - 1)];
+  if (!__atomic_compare_exchange_n(&w->top, &t, t + 1, false,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return ABORT;
+  }
+  return object;
+}
+
+
+static void fillGap(Address start, Address end) {
+  Word size;
+
+  /* make a dummy byte object of class nil out of a gap */
+  if (start == end) {
+    return;
+  }
+  size = end - start - HEADER_SIZE;
+  if (size >= SIZE_OVERFLOW) {
+    size -= HEADER_SIZE;
+    writeWord(start, size);
+    writeInfo(start, SIZE_OVERFLOW);
+    start += HEADER_SIZE;
+    writeClass(start, machine.nil);
+    writeInfo(start, SIZE_OVERFLOW);
+  } else {
+    writeClass(start, machine.nil);
+    writeInfo(start, size);
+  }
+}
+
+
+static Address allocateCopy(Worker *w, Address length, Bool *inBuffer) {
+  Address start;
+
+  /* small copies go into the buffer, which is replaced if */
+  /* only a small part of it is left, others get their own */
+  /* space, so that little memory is wasted */
+  if (w->labFree + length > w->labEnd &&
+      w->labEnd - w->labFree < LAB_SIZE / 16 &&
+      length <= LAB_SIZE / 4) {
+    fillGap(w->labFree, w->labEnd);
+    w->labFree = __atomic_fetch_add(&parallelFree, LAB_SIZE,
+                                    __ATOMIC_RELAXED);
+    w->labEnd = w->labFree + LAB_SIZE;
+    if (w->labEnd > toEnd) {
+      sysError("copyObject has no space");
+    }
+  }
+  if (w->labFree + length <= w->labEnd) {
+    start = w->labFree;
+    w->labFree += length;
+    *inBuffer = true;
+    return start;
+  }
+  start = __atomic_fetch_add(&parallelFree, length, __ATOMIC_RELAXED);
+  if (start + length > toEnd) {
+    sysError("copyObject has no space");
+  }
+  *inBuffer = false;
+  return start;
+}
+
+
+static ObjPtr waitForward(ObjPtr object) {
+  Word forward;
+
+  /* another worker is copying the object, wait for it */
+  while ((forward = __atomic_load_n((Word *) (memory + object),
+                                    __ATOMIC_ACQUIRE)) == 0) {
+    sched_yield();
+  }
+  return forward;
+}
+
+
+static ObjPtr parallelUpdatePointer(Worker *w, ObjPtr object) {
+  Header header;
+  Header forward;
+  Address start;
+  Address length;
+  Address extra;
+  Bool inBuffer;
+  ObjPtr copy;
+  Word info;
+
+  /* like updatePointer, but safe against the other workers */
+  if (object & IS_SHORTINT) {
+    return object;
+  }
+  if (!isCollected(object)) {
+    return object;
+  }
+  if (isLargeObject(object)) {
+    info = __atomic_fetch_or((Word *) (memory + object + sizeof(Word)),
+                             MARKED, __ATOMIC_RELAXED);
+    if ((info & MARKED) == 0) {
+      pushWork(w, object);
+    }
+    return object;
+  }
+  header.all = __atomic_load_n((unsigned long *) (memory + object),
+                               __ATOMIC_ACQUIRE);
+  if (header.half[1] & BROKEN_HEART) {
+    return header.half[0] != 0 ? header.half[0] : waitForward(object);
+  }
+  length = objectLength(object);
+  extra = isLarge(object) ? HEADER_SIZE : 0;
+  forward.half[1] = header.half[1] | BROKEN_HEART;
+  if (length + extra > LAB_SIZE / 4) {
+    /* big objects are claimed before they are copied, with */
+    /* a forward pointer of 0, so that no space is wasted */
+    forward.half[0] = 0;
+    if (!__atomic_compare_exchange_n((unsigned long *) (memory + object),
+                                     &header.all, forward.all, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return header.half[0] != 0 ? header.half[0] : waitForward(object);
+    }
+    start = allocateCopy(w, length + extra, &inBuffer);
+    memcpy(memory + start, memory + object - extra, length + extra);
+    copy = (ObjPtr) start + extra;
+    /* the copy must not show the claim */
+    writeClass(copy, header.half[0]);
+    writeInfo(copy, header.half[1]);
+    __atomic_store_n((Word *) (memory + object), (Word) copy,
+                     __ATOMIC_RELEASE);
+  } else {
+    /* small objects are copied first, then the forward */
+    /* pointer is installed, unless another worker did so */
+    start = allocateCopy(w, length + extra, &inBuffer);
+    memcpy(memory + start, memory + object - extra, length + extra);
+    copy = (ObjPtr) start + extra;
+    forward.half[0] = (Word) copy;
+    if (!__atomic_compare_exchange_n((unsigned long *) (memory + object),
+                                     &header.all, forward.all, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      /* take back the copy, or leave a gap */
+      if (inBuffer) {
+        w->labFree = start;
+      } else {
+        fillGap(start, start + length + extra);
+      }
+      return header.half[0] != 0 ? header.half[0] : waitForward(object);
+    }
+  }
+  w->numBytes += length + extra;
+  w->numObjects++;
+  pushWork(w, copy);
+  return copy;
+}
+
+
+static void parallelUpdateFields(Worker *w, ObjPtr object) {
+  ObjPtr *field;
+  Word size;
+  Word i;
+
+  writeClass(object, parallelUpdatePointer(w, readClass(object)));
+  if ((readInfo(object) & HAS_POINTERS) == 0) {
+    return;
+  }
+  size = readSize(object);
+  field = (ObjPtr *) (memory + object + HEADER_SIZE);
+  for (i = 0; i < size; i++) {
+    if (i + PREFETCH_DISTANCE < size) {
+      prefetchObject(field[i + PREFETCH_DISTANCE]);
+    }
+    field[i] = parallelUpdatePointer(w, field[i]);
+  }
+}
+
+
+static Bool findWork(Worker *w, ObjPtr *object) {
+  int i, n;
+  ObjPtr stolen;
+
+  /* steal from the others; if they are all idle, we are done */
+  n = w - workers;
+  for (;;) {
+    for (i = 1; i < gcThreads; i++) {
+      do {
+        stolen = stealWork(&workers[(n + i) % gcThreads]);
+      } while (stolen == ABORT);
+      if (stolen != 0) {
+        *object = stolen;
+        return true;
+      }
+    }
+    __atomic_add_fetch(&numIdle, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+      if (__atomic_load_n(&numIdle, __ATOMIC_SEQ_CST) == gcThreads) {
+        return false;
+      }
+      for (i = 0; i < gcThreads; i++) {
+        if (__atomic_load_n(&workers[i].top, __ATOMIC_SEQ_CST) <
+            __atomic_load_n(&workers[i].bottom, __ATOMIC_SEQ_CST)) {
+          break;
+        }
+      }
+      if (i < gcThreads) {
+        break;
+      }
+      sched_yield();
+    }
+    __atomic_sub_fetch(&numIdle, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+
+static void *runWorker(void *arg) {
+  Worker *w;
+  ObjPtr object;
+
+  w = arg;
+  for (;;) {
+    while ((object = popWork(w)) != 0) {
+      parallelUpdateFields(w, object);
+    }
+    if (!findWork(w, &object)) {
+      break;
+    }
+    parallelUpdateFields(w, object);
+  }
+  return NULL;
+}
+
+
+static Bool parallelScan(Address toScan) {
+  Worker *w;
+  ObjPtr object;
+  int i, j;
+
+  /* the workers take over scanning, if there is room enough */
+  /* in the "to" semispace for their buffers; answer whether */
+  /* they did */
+  if (gcThreads < 2 || !majorGC || collectPerm ||
+      toStart + copyBound + copyBound / 8 +
+      gcThreads * LAB_SIZE > toEnd) {
+    return false;
+  }
+  workers = allocate(gcThreads * sizeof(Worker));
+  for (i = 0; i < gcThreads; i++) {
+    w = &workers[i];
+    w->top = 0;
+    w->bottom = 0;
+    w->deque = newDequeArray(DEQUE_SIZE);
+    w->numRetired = 0;
+    w->labFree = 0;
+    w->labEnd = 0;
+    w->numBytes = 0;
+    w->numObjects = 0;
+  }
+  /* the first worker gets all objects which are yet to be scanned */
+  while (toScan != toFree) {
+    object = objectAt(toScan);
+    pushWork(&workers[0], object);
+    toScan = object + objectLength(object);
+  }
+  for (i = 0; i < numMarked; i++) {
+    pushWork(&workers[0], markedObjects[i]);
+  }
+  numIdle = 0;
+  parallelFree = toFree;
+  /* the main thread is the first worker */
+  for (i = 1; i < gcThreads; i++) {
+    if (pthread_create(&workers[i].thread, NULL, runWorker, &workers[i])) {
+      sysError("cannot create GC thread");
+    }
+  }
+  runWorker(&workers[0]);
+  for (i = 1; i < gcThreads; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  /* fill the rest of the buffers, and clean up */
+  toFree = parallelFree;
+  for (i = 0; i < gcThreads; i++) {
+    w = &workers[i];
+    fillGap(w->labFree, w->labEnd);
+    numBytes += w->numBytes;
+    numObjects += w->numObjects;
+    for (j = 0; j < w->numRetired; j++) {
+      release(w->retired[j]->array);
+      release(w->retired[j]);
+    }
+    release(w->deque->array);
+    release(w->deque);
+  }
+  release(workers);
+  workers = NULL;
+  return true;
+}
+
+
+static void forgetRemembered(Bool all) {
+  int i, j;
+  ObjPtr object;
+
+  /* permanent objects are kept unless all are forgotten */
+  j = 0;
+  for (i = 0; i < numRemembered; i++) {
+    object = remembered[i];
+    if (!all && isPermObject(object)) {
+      remembered[j++] = object;
+    } else {
+      writeInfo(object, readInfo(object) & ~REMEMBERED);
+    }
+  }
+  numRemembered = j;
+}
+
+
+static void rememberRegisters(void) {
+  /* the arrays of the active context are always remembered */
+  rememberObject(machine.currentTemps);
+  rememberObject(machine.currentStack);
+}
+
+
+static void releasePages(Address start, Address end) {
+  /* give the whole pages between two addresses back to the */
+  /* system, they read as zeroes when touched again */
+  start = (start + pageSize - 1) & ~(pageSize - 1);
+  end &= ~(pageSize - 1);
+  if (start < end) {
+    madvise(memory + start, end - start, MADV_DONTNEED);
+  }
+}
+
+
+static void placeSpaces(Address size) {
+  Address end;
+
+  /* place semispaces of the given size above the permanent */
+  /* space; the objects in the lower semispace keep their */
+  /* addresses, the upper semispace and the nursery become */
+  /* empty, and pages which are no longer used are released */
+  end = permEnd + 2 * size + nurserySize;
+  if (end > largeStart) {
+    sysError("object memory exhausted");
+  }
+  if (end < nurseryEnd) {
+    releasePages(end, nurseryEnd);
+  }
+  semiSize = size;
+  toStart = permEnd;
+  toEnd = toStart + size;
+  fromStart = toEnd;
+  fromEnd = fromStart + size;
+  nurseryStart = fromEnd;
+  nurseryEnd = nurseryStart + (Address) nurserySize;
+  nurseryFree = nurseryStart;
+}
+
+
+static Address chunkStart(ObjPtr object) {
+  /* a large object starts its chunk, unless its size is in front */
+  return isLarge(object) ? object - HEADER_SIZE : object;
+}
+
+
+static Address chunkLength(ObjPtr object) {
+  /* the length of the chunk taken by a large object */
+  return (object + objectLength(object) - chunkStart(object) +
+          pageSize - 1) & ~(pageSize - 1);
+}
+
+
+static Address allocateChunk(Address length) {
+  Address start;
   int i;
 
-  /* don't do collections if GC is disabled */
-  if (!enableGC) {
+  /* take the first free chunk which is large enough, else */
+  /* extend the large-object space downwards; answer 0 if */
+  /* this would run into the nursery */
+  for (i = 0; i < numFreeChunks; i++) {
+    if (freeChunks[i].length >= length) {
+      start = freeChunks[i].start;
+      freeChunks[i].start += length;
+      freeChunks[i].length -= length;
+      if (freeChunks[i].length == 0) {
+        numFreeChunks--;
+        memmove(&freeChunks[i], &freeChunks[i + 1],
+                (numFreeChunks - i) * sizeof(Chunk));
+      }
+      largeUsed += length;
+      return start;
+    }
+  }
+  if (largeStart - nurseryEnd < length) {
+    return 0;
+  }
+  largeStart -= length;
+  largeUsed += length;
+  return largeStart;
+}
+
+
+static void freeChunk(Address start, Address length) {
+  int i;
+
+  /* release the pages of the chunk; the free chunks are kept */
+  /* sorted by address, so that neighbours can be merged */
+  releasePages(start, start + length);
+  largeUsed -= length;
+  if (start == largeStart) {
+    /* the lowest chunk just shrinks the space, */
+    /* together with a free chunk above it */
+    largeStart += length;
+    if (numFreeChunks > 0 && freeChunks[0].start == largeStart) {
+      largeStart += freeChunks[0].length;
+      numFreeChunks--;
+      memmove(&freeChunks[0], &freeChunks[1],
+              numFreeChunks * sizeof(Chunk));
+    }
     return;
   }
+  i = 0;
+  while (i < numFreeChunks && freeChunks[i].start < start) {
+    i++;
+  }
+  if (i > 0 && freeChunks[i - 1].start + freeChunks[i - 1].length == start) {
+    /* merge with the chunk below, and maybe with the one above */
+    freeChunks[i - 1].length += length;
+    if (i < numFreeChunks && start + length == freeChunks[i].start) {
+      freeChunks[i - 1].length += freeChunks[i].length;
+      numFreeChunks--;
+      memmove(&freeChunks[i], &freeChunks[i + 1],
+              (numFreeChunks - i) * sizeof(Chunk));
+    }
+    return;
+  }
+  if (i < numFreeChunks && start + length == freeChunks[i].start) {
+    /* merge with the chunk above */
+    freeChunks[i].start = start;
+    freeChunks[i].length += length;
+    return;
+  }
+  if (numFreeChunks == maxFreeChunks) {
+    maxFreeChunks = maxFreeChunks == 0 ? 64 : 2 * maxFreeChunks;
+    freeChunks = reallocate(freeChunks, maxFreeChunks * sizeof(Chunk));
+  }
+  memmove(&freeChunks[i + 1], &freeChunks[i],
+          (numFreeChunks - i) * sizeof(Chunk));
+  freeChunks[i].start = start;
+  freeChunks[i].length = length;
+  numFreeChunks++;
+}
+
+
+static void sweepLarge(void) {
+  Address freed;
+  ObjPtr object;
+  Word info;
+  int i, j;
+
+  /* free the large objects which have not been marked, */
+  /* and clear the marks of the others */
+  freed = 0;
+  j = 0;
+  for (i = 0; i < numLargeObjects; i++) {
+    object = largeObjects[i];
+    info = readInfo(object);
+    if (info & MARKED) {
+      writeInfo(object, info & ~MARKED);
+      largeObjects[j++] = object;
+    } else {
+      freed += chunkLength(object);
+      freeChunk(chunkStart(object), chunkLength(object));
+    }
+  }
+  if (debugMemory && numLargeObjects != 0) {
+    printf("    %lu bytes in %d large objects freed, %d kept\n",
+           freed, numLargeObjects - j, j);
+  }
+  numLargeObjects = j;
+  numMarked = 0;
+  /* the next major collection is due when the large objects */
+  /* have grown by the size of a semispace, so that the costs */
+  /* of copying the old space are spread as before */
+  largeLimit = largeUsed + semiSize;
+}
+
+
+static void evacuate(void);
+
+
+static void collect(Bool major) {
+  Address tmp;
+
+  majorGC = major;
   /* print allocation statistics and init collection statistics */
   if (debugMemory) {
-    printf("GC: %u bytes in %u objects allocated since last collection\n",
-           numBytes, numObjects);
+    printf("%s GC: %u bytes in %u objects allocated since last collection\n",
+           major ? "major" : "minor", numBytes, numObjects);
     numBytes = 0;
     numObjects = 0;
   }
-  /* flip semispaces */
-  tmp = toStart;
-  toStart = fromStart;
-  fromStart = tmp;
-  tmp = toEnd;
-  toEnd = fromEnd;
-  fromEnd = tmp;
-  /* set-up free and scan pointers */
-  toFree = toStart;
+  if (major) {
+    copyBound = (toFree - toStart) + (nurseryFree - nurseryStart);
+    /* all living objects get copied, none needs to be remembered, */
+    /* except for permanent objects which point to other objects */
+    forgetRemembered(collectPerm);
+    /* flip semispaces */
+    tmp = toStart;
+    toStart = fromStart;
+    fromStart = tmp;
+    tmp = toEnd;
+    toEnd = fromEnd;
+    fromEnd = tmp;
+    /* set-up free pointer */
+    toFree = toStart;
+  }
+  evacuate();
+  /* only major collections find dead large objects, */
+  /* incremental ones when they have ended */
+  if (major && !gcCycle) {
+    sweepLarge();
+  }
+}
+
+
+static void evacuate(void) {
+  Address toScan;
+  Address stackScan;
+  int largeScan;
+  ObjPtr object;
+  struct timespec start;
+  struct timespec stop;
+  double seconds;
+  int i;
+
+  /* collections are timed by the wall clock, since the */
+  /* workers of a parallel one run at the same time */
+  if (debugMemory) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+  }
+  /* the objects copied now are appended to the old space */
   toScan = toFree;
   /* first relocate the roots of the world, i.e. all object registers */
   UPDATE(machine.nil);
@@ -187,6 +1088,8 @@ static void doGC(void) {
   UPDATE(machine.Smalltalk);
   UPDATE(machine.ShortInteger);
   UPDATE(machine.Float);
+  UPDATE(machine.LargePositiveInteger);
+  UPDATE(machine.LargeNegativeInteger);
   UPDATE(machine.Character);
   UPDATE(machine.String);
   UPDATE(machine.Symbol);
@@ -210,159 +1113,726 @@ static void doGC(void) {
   UPDATE(machine.newContext);
   UPDATE(machine.compilerMethod);
   UPDATE(machine.compilerLiteral);
-  /* then relocate the rest of the world iteratively */
-  while (toScan != toFree) {
-    /* there is another object to scan */
-    /* update class pointer of object */
-    writeClass((ObjPtr) toScan, updatePointer(readClass((ObjPtr) toScan)));
-    /* read size and let scan pointer point to object's body */
-    size = readSize((ObjPtr) toScan);
-    toScan += sizeof(ObjPtr) + sizeof(Word) + sizeof(Word);
-    /* inspect pointer flag */
-    if (size & HAS_POINTERS) {
-      /* object has pointers, update them */
-      size &= ~(HAS_POINTERS | HAS_WORDS);
-      while (size--) {
-        writeObjPtr(toScan, updatePointer(readObjPtr(toScan)));
-        toScan += sizeof(ObjPtr);
+  UPDATE(allocClass);
+  /* the objects in the stack zone are roots as well; they */
+  /* stay where they are, but their contents get relocated */
+  stackScan = stackStart;
+  while (stackScan != stackTop) {
+    updateFields((ObjPtr) stackScan, false);
+    stackScan += objectLength((ObjPtr) stackScan);
+  }
+  /* so are the remembered objects, the semispace ones of */
+  /* which are remembered only in minor collections */
+  for (i = 0; i < numRemembered; i++) {
+    updateFields(remembered[i], false);
+  }
+  forgetRemembered(false);
+  /* then relocate the rest of the world iteratively; */
+  /* objects without pointers only need their class; */
+  /* an incremental collection leaves this to its increments */
+  if (majorGC && gcCycle) {
+    cycleScan = toScan;
+    cycleLargeScan = 0;
+    cycleLargeField = 0;
+    numPromotedRuns = 0;
+    nextPromotedRun = 0;
+  } else
+  if (!parallelScan(toScan)) {
+    largeScan = 0;
+    while (toScan != toFree || largeScan != numMarked) {
+      while (toScan != toFree) {
+        object = objectAt(toScan);
+        updateFields(object, true);
+        toScan = object + objectLength(object);
       }
-    } else {
-      /* object has no pointers, skip it */
-      if (size & HAS_WORDS) {
-        size &= ~HAS_WORDS;
-        toScan += size * sizeof(Word);
-      } else {
-        toScan += size * sizeof(Byte);
+      while (largeScan != numMarked) {
+        updateFields(markedObjects[largeScan++], true);
       }
     }
-    /* satisfy alignment restrictions */
-    while (toScan & ALIGN_MASK) {
-      toScan++;
-    }
   }
+  /* the nursery is empty now */
+  nurseryFree = nurseryStart;
+  rememberRegisters();
   /* print collection statistics and init allocation statistics */
   if (debugMemory) {
-    printf("    %u bytes in %u objects copied during this collection\n",
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    seconds = (stop.tv_sec - start.tv_sec) +
+              (stop.tv_nsec - start.tv_nsec) / 1e9;
+    numCollections++;
+    totalBytes += numBytes;
+    totalSeconds += seconds;
+    printf("    %u bytes in %u objects copied during this collection",
            numBytes, numObjects);
-    printf("    %lu of %lu bytes are now free\n",
-           (Address) SEMI_SIZE * sizeof(Byte) - numBytes,
-           (Address) SEMI_SIZE * sizeof(Byte));
+    if (seconds > 0) {
+      printf(", %.1f MB/s", numBytes / seconds / M);
+    }
+    printf("\n");
+    printf("    %lu of %lu bytes of old space are now free\n",
+           toEnd - toFree, semiSize);
     numBytes = 0;
     numObjects = 0;
   }
+  /* let the machine re-key its caches by the new addresses */
+  relocateCaches();
+}
+
+
+static void resizeHeap(Address extra) {
+  Address used;
+  Address size;
+  Address limit;
+
+  /* find a semispace size for which the old space, including */
+  /* extra bytes, is between an eighth and one half used; */
+  /* incremental collections start at one half, so the old */
+  /* space should only be a quarter used after them */
+  used = toFree - toStart + extra;
+  size = semiSize;
+  limit = gcPauseMicros != 0 ? 4 : 2;
+  while (used > size / limit) {
+    size *= 2;
+  }
+  while (size / 2 >= heapSize && used < size / 8) {
+    size /= 2;
+  }
+  if (size == semiSize) {
+    return;
+  }
+  /* only the lower semispace keeps its contents, */
+  /* so the nursery must be emptied first */
+  if (nurseryFree != nurseryStart) {
+    collect(toFree + (nurseryFree - nurseryStart) > toEnd);
+  }
+  if (toStart != permEnd) {
+    if (gcPauseMicros != 0 && size > semiSize) {
+      /* a grown lower semispace takes in the upper one, so */
+      /* its objects can stay, behind a gap; this avoids the */
+      /* pause of a full collection */
+      fillGap(permEnd, toStart);
+      toStart = permEnd;
+    } else {
+      collect(true);
+    }
+  }
+  if (debugMemory) {
+    printf("    %s semispaces from %lu to %lu bytes\n",
+           size > semiSize ? "growing" : "shrinking", semiSize, size);
+  }
+  placeSpaces(size);
+}
+
+
+static double elapsedSeconds(struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) +
+         (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+static void recordPause(struct timespec *start) {
+  double seconds;
+  double micros;
+  int i;
+
+  /* enter the length of a pause into the histogram */
+  seconds = elapsedSeconds(start);
+  micros = seconds * 1e6;
+  i = 0;
+  while (i < PAUSE_BUCKETS - 1 && micros >= (double) (1UL << i)) {
+    i++;
+  }
+  pauseCounts[i]++;
+  numPauses++;
+  totalPauses += seconds;
+  if (seconds > longestPause) {
+    longestPause = seconds;
+  }
+}
+
+
+static void scanIncrement(double micros) {
+  struct timespec start;
+  ObjPtr object;
+  ObjPtr *field;
+  Word size;
+  Word i;
+  unsigned long n;
+
+  /* scan the objects copied by an incremental collection for */
+  /* the given time, or to the end if it is 0; at least some */
+  /* objects are scanned, so that the collection makes progress */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  majorGC = true;
+  n = 0;
+  while (cycleScan != toFree || cycleLargeScan != numMarked) {
+    if (micros != 0 && (++n & 63) == 0 && n > 256 &&
+        elapsedSeconds(&start) * 1e6 >= micros) {
+      return;
+    }
+    if (cycleScan != toFree) {
+      /* objects promoted meanwhile can only point to objects */
+      /* which have been copied or marked, so they are skipped */
+      if (nextPromotedRun < numPromotedRuns &&
+          cycleScan == promotedRuns[nextPromotedRun].start) {
+        cycleScan += promotedRuns[nextPromotedRun].length;
+        nextPromotedRun++;
+        continue;
+      }
+      object = objectAt(cycleScan);
+      updateFields(object, true);
+      cycleScan = object + objectLength(object);
+    } else {
+      /* large objects are scanned a few fields at a time */
+      object = markedObjects[cycleLargeScan];
+      if (cycleLargeField == 0) {
+        writeClass(object, updatePointer(readClass(object)));
+      }
+      size = (readInfo(object) & HAS_POINTERS) ? readSize(object) : 0;
+      field = (ObjPtr *) (memory + object + HEADER_SIZE);
+      for (i = cycleLargeField; i < size && i < cycleLargeField + 64; i++) {
+        field[i] = updatePointer(field[i]);
+      }
+      cycleLargeField = i;
+      if (i == size) {
+        cycleLargeScan++;
+        cycleLargeField = 0;
+      }
+    }
+  }
+  /* all living objects have been copied or marked now */
+  gcCycle = false;
+  sweepLarge();
+  resizeDue = true;
+  if (debugMemory) {
+    printf("    incremental collection ended, "
+           "%lu of %lu bytes of old space are now free\n",
+           toEnd - toFree, semiSize);
+  }
+}
+
+
+static void startCycle(void) {
+  /* empty the nursery into the old space, then flip the */
+  /* semispaces and relocate the roots; the increments do */
+  /* the rest of the collection */
+  if (nurseryFree != nurseryStart) {
+    collect(false);
+  }
+  cycleFromUsed = toFree - toStart;
+  cyclePromoted = 0;
+  numCycles++;
+  gcCycle = true;
+  collect(true);
+}
+
+
+static void finishCycle(void) {
+  /* do the rest of an incremental collection at once; the */
+  /* objects it finds in the nursery are promoted, and the */
+  /* next minor collection relocates the roots to them */
+  if (!gcCycle) {
+    return;
+  }
+  numFinished++;
+  scanIncrement(0);
+}
+
+
+static void adaptHeap(void) {
+  /* after an incremental collection, the semispaces are only */
+  /* resized when it has ended in the lower one, so that no */
+  /* objects have to be moved, unless the old space is still */
+  /* half full, which would start the next collection at once */
+  if (!resizeDue || gcCycle) {
+    return;
+  }
+  resizeDue = false;
+  if (toStart == permEnd || toFree - toStart > semiSize / 2) {
+    resizeHeap(toStart - permEnd);
+  }
+}
+
+
+static void doIncrementalGC(Bool major, struct timespec *start) {
+  Address young;
+  Address promoted;
+  double micros;
+
+  young = nurseryFree - nurseryStart;
+  if (gcCycle &&
+      toStart + cycleFromUsed + cyclePromoted + young <= OLD_END) {
+    /* the "to" semispace can still take all objects of the */
+    /* "from" semispace which have not been copied yet, even */
+    /* after the nursery has been promoted, so go on */
+    promoted = toFree;
+    collect(false);
+    if (toFree != promoted) {
+      if (numPromotedRuns == maxPromotedRuns) {
+        maxPromotedRuns = maxPromotedRuns == 0 ? 64 : 2 * maxPromotedRuns;
+        promotedRuns = reallocate(promotedRuns,
+                                  maxPromotedRuns * sizeof(Chunk));
+      }
+      promotedRuns[numPromotedRuns].start = promoted;
+      promotedRuns[numPromotedRuns].length = toFree - promoted;
+      numPromotedRuns++;
+    }
+    cyclePromoted += toFree - promoted;
+    /* the increment takes the rest of the pause target, but */
+    /* at least half of it, whatever the minor collection took */
+    micros = gcPauseMicros - elapsedSeconds(start) * 1e6;
+    if (micros < gcPauseMicros / 2.0) {
+      micros = gcPauseMicros / 2.0;
+    }
+    scanIncrement(micros);
+  } else {
+    /* else finish the collection at once; start a new one */
+    /* when the old space is half full or a major collection */
+    /* is asked for, or else empty the nursery only */
+    if (gcCycle) {
+      finishCycle();
+      adaptHeap();
+      major = false;
+    }
+    young = nurseryFree - nurseryStart;
+    if (major || toFree + young > toStart + semiSize / 2) {
+      startCycle();
+    } else {
+      collect(false);
+    }
+  }
+  adaptHeap();
+}
+
+
+static void doGC(Bool major) {
+  struct timespec start;
+
+  /* don't do collections if GC is disabled */
+  if (!enableGC) {
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (gcPauseMicros != 0) {
+    doIncrementalGC(major, &start);
+    recordPause(&start);
+    return;
+  }
+  /* a minor collection must be able to promote the whole nursery */
+  if (toFree + (nurseryFree - nurseryStart) > OLD_END) {
+    major = true;
+  }
+  collect(major);
+  /* after a major collection, adapt the heap to the living objects */
+  if (major) {
+    resizeHeap(0);
+  }
+  recordPause(&start);
+}
+
+
+static void completeGC(void) {
+  struct timespec start;
+
+  /* finish an incremental collection which is in progress */
+  if (gcCycle) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    finishCycle();
+    recordPause(&start);
+  }
+}
+
+
+static void showPauses(void) {
+  unsigned long count;
+  int i;
+
+  /* print the distribution of the pauses for collections */
+  if (numPauses == 0) {
+    return;
+  }
+  printf("%lu GC pauses, longest %.3f ms, mean %.3f ms\n",
+         numPauses, longestPause * 1e3, totalPauses / numPauses * 1e3);
+  count = 0;
+  for (i = 0; i < PAUSE_BUCKETS; i++) {
+    if (pauseCounts[i] == 0) {
+      continue;
+    }
+    count += pauseCounts[i];
+    printf("    %8lu pauses below %10lu us (%5.1f%%)\n",
+           pauseCounts[i], 1UL << i, 100.0 * count / numPauses);
+  }
+  if (numCycles != 0) {
+    printf("    %lu incremental collections, %lu finished at once\n",
+           numCycles, numFinished);
+  }
 }
 
 
 static void initGC(void) {
-  /* "to" semispace initially starts at 0 */
-  toStart = (Address) 0;
-  toEnd = toStart + (Address) SEMI_SIZE * sizeof(Byte);
-  /* "from" semispace starts where "to" semispace ends */
-  fromStart = toEnd;
-  fromEnd = fromStart + (Address) SEMI_SIZE * sizeof(Byte);
-  /* first free byte depends on how much was loaded */
-  toFree = toStart + (Address) machine.memorySize * sizeof(Byte);
+  /* all loaded objects are permanent, the old space is empty */
+  toFree = toStart;
+  /* the remembered set is empty, up to the active context */
+  remembered = NULL;
+  numRemembered = 0;
+  maxRemembered = 0;
+  /* the large-object space is empty */
+  freeChunks = NULL;
+  numFreeChunks = 0;
+  maxFreeChunks = 0;
+  largeObjects = NULL;
+  markedObjects = NULL;
+  numLargeObjects = 0;
+  maxLargeObjects = 0;
+  numMarked = 0;
+  largeUsed = 0;
+  largeLimit = heapSize;
+  /* no incremental collection is in progress */
+  promotedRuns = NULL;
+  numPromotedRuns = 0;
+  maxPromotedRuns = 0;
+  majorGC = false;
+  collectPerm = false;
+  allocClass = machine.nil;
+  rememberRegisters();
   /* init allocation statistics */
   if (debugMemory) {
+    printf("%lu bytes of objects %s into permanent space\n",
+           permEnd - permStart,
+           imageMapped ? "mapped" :
+           imageConverted ? "converted" :
+           machine.compressedSize != 0 ? "expanded" : "loaded");
     numBytes = 0;
     numObjects = 0;
   }
 }
 
 
-static void exitGC(void) {
-  /* do a collection to get objects compacted */
-  doGC();
-  /* check whether in lower semispace */
-  if (toStart != (Address) 0) {
-    /* it's the upper one, so collect again to switch semispaces */
-    doGC();
+static void compactMemory(void) {
+  /* a collection in progress must be finished first */
+  completeGC();
+  /* a semispace must be able to take all objects */
+  resizeHeap(permEnd - permStart + largeUsed);
+  /* collect all objects, the permanent ones included */
+  collectPerm = true;
+  collect(true);
+  /* check whether in lower semispace */
+  if (toStart == permEnd) {
+    /* it's the lower one, so collect again to switch semispaces */
+    collect(true);
+  }
+  collectPerm = false;
+  /* then move the objects down to the base of the permanent */
+  /* space, which is free now, as is the lower semispace */
+  forgetRemembered(true);
+  fromStart = toStart;
+  fromEnd = toFree;
+  toStart = permStart;
+  toEnd = fromStart;
+  toFree = toStart;
+  evacuate();
+  /* compute total size of all objects in bytes */
+  machine.memorySize = toFree - toStart;
+}
+
+
+static void exitGC(void) {
+  /* all objects are moved to the base of the permanent space */
+  compactMemory();
+  if (debugMemory) {
+    printf("%lu collections copied %.0f bytes in %.3f seconds",
+           numCollections, totalBytes, totalSeconds);
+    if (totalSeconds > 0) {
+      printf(", %.1f MB/s", totalBytes / totalSeconds / M);
+    }
+    printf("\n");
+  }
+  if (debugMemory || gcPauseMicros != 0) {
+    showPauses();
+  }
+  /* release the remembered set, the image must not show it */
+  forgetRemembered(true);
+  if (remembered != NULL) {
+    release(remembered);
+    remembered = NULL;
+  }
+  numRemembered = 0;
+  maxRemembered = 0;
+  /* the large objects have been copied, too */
+  if (freeChunks != NULL) {
+    release(freeChunks);
+    freeChunks = NULL;
+  }
+  if (largeObjects != NULL) {
+    release(largeObjects);
+    release(markedObjects);
+    largeObjects = NULL;
+    markedObjects = NULL;
+  }
+  if (promotedRuns != NULL) {
+    release(promotedRuns);
+    promotedRuns = NULL;
+  }
+}
+
+
+/**************************************************************/
+
+/* interface */
+
+
+static ObjPtr allocateObject(ObjPtr class, int size,
+                             Bool hasPtrs, Bool hasWords) {
+  Address start;
+  Word length;
+  Word extra;
+  Word info;
+  ObjPtr object;
+
+  /* compute length of object in bytes, and of its size in front */
+  length = HEADER_SIZE;
+  if (hasPtrs) {
+    length += size * sizeof(ObjPtr);
+  } else {
+    if (hasWords) {
+      length += size * sizeof(Word);
+    } else {
+      length += size * sizeof(Byte);
+    }
+  }
+  length = (length + ALIGN_MASK) & ~ALIGN_MASK;
+  extra = size >= SIZE_OVERFLOW ? HEADER_SIZE : 0;
+  length += extra;
+  if (!enableGC) {
+    /* all objects are allocated in the old space */
+    /* while collections are disabled */
+    if (toFree + length > OLD_END) {
+      /* ATTENTION: don't forget to update the class pointer! It */
+      /* is a root during the collections, so that it survives */
+      /* even if the objects are copied twice. */
+      allocClass = class;
+      /* grow the heap */
+      resizeHeap(length);
+      class = allocClass;
+      /* check for object memory overflow */
+      if (toFree + length > OLD_END) {
+        sysError("object memory exhausted");
+      }
+    }
+    /* allocate the requested space */
+    object = (ObjPtr) toFree + extra;
+    toFree += length;
+  } else {
+    if (length > nurserySize / 4) {
+      /* large objects get a chunk of their own; when the */
+      /* large-object space has grown enough or is full, */
+      /* do a major collection first, see above */
+      length = (length + pageSize - 1) & ~(pageSize - 1);
+      allocClass = class;
+      if (largeUsed + length > largeLimit) {
+        doGC(true);
+      }
+      start = allocateChunk(length);
+      if (start == 0) {
+        doGC(true);
+        start = allocateChunk(length);
+        if (start == 0) {
+          completeGC();
+          start = allocateChunk(length);
+        }
+        if (start == 0) {
+          sysError("object memory exhausted");
+        }
+      }
+      class = allocClass;
+      object = (ObjPtr) start + extra;
+      if (numLargeObjects == maxLargeObjects) {
+        maxLargeObjects = maxLargeObjects == 0 ? 64 : 2 * maxLargeObjects;
+        largeObjects = reallocate(largeObjects,
+                                  maxLargeObjects * sizeof(ObjPtr));
+        markedObjects = reallocate(markedObjects,
+                                   maxLargeObjects * sizeof(ObjPtr));
+      }
+      largeObjects[numLargeObjects++] = object;
+    } else {
+      /* check if remaining space is large enough */
+      if (nurseryFree + length > nurseryEnd) {
+        /* not large enough, do a collection, see above */
+        allocClass = class;
+        doGC(false);
+        class = allocClass;
+      }
+      /* allocate the requested space */
+      object = (ObjPtr) nurseryFree + extra;
+      nurseryFree += length;
+    }
+  }
+  /* update allocation statistics */
+  if (debugMemory) {
+    numBytes += length;
+    numObjects++;
+  }
+  /* set class, flags and size, the hash is assigned lazily */
+  writeClass(object, class);
+  if (extra != 0) {
+    writeWord(object - HEADER_SIZE, size);
+    writeInfo(object - HEADER_SIZE, SIZE_OVERFLOW);
+    info = SIZE_OVERFLOW;
+  } else {
+    info = size;
+  }
+  if (hasPtrs) {
+    info |= HAS_POINTERS;
+  } else {
+    if (hasWords) {
+      info |= HAS_WORDS;
+    }
+  }
+  /* large objects are marked while a collection is in */
+  /* progress, they can only point to marked objects */
+  if (gcCycle && isLargeObject(object)) {
+    info |= MARKED;
+  }
+  writeInfo(object, info);
+  /* the fields are left to the caller */
+  return object;
+}
+
+
+ObjPtr createObject(ObjPtr class, int size,
+                    Bool hasPtrs, Bool hasWords) {
+  ObjPtr object;
+  ObjPtr *field;
+  int i;
+
+  object = allocateObject(class, size, hasPtrs, hasWords);
+  if (hasPtrs) {
+    /* ATTENTION: the following initialization is required! */
+    /* default object pointer value is nil */
+    field = (ObjPtr *) (memory + object + HEADER_SIZE);
+    for (i = 0; i < size; i++) {
+      field[i] = machine.nil;
+    }
+  } else {
+    /* default word and byte values are 0 */
+    memset(memory + object + HEADER_SIZE, 0,
+           size * (hasWords ? sizeof(Word) : sizeof(Byte)));
+  }
+  /* return the object created just now */
+  return object;
+}
+
+
+ObjPtr createRawObject(ObjPtr class, int size, Bool hasWords) {
+  /* the contents of a word or byte object are undefined, */
+  /* the caller must set them; there is no pointer variant, */
+  /* since the collector must not see undefined pointers */
+  return allocateObject(class, size, false, hasWords);
+}
+
+
+ObjPtr createStackObject(ObjPtr class, int size) {
+  ObjPtr object;
+  ObjPtr *field;
+  int i;
+
+  /* the caller has checked that there is enough room; */
+  /* stack objects always have pointers and need no hash, */
+  /* and they are never large enough to need a size in front */
+  object = createRawStackObject(class, size);
+  field = (ObjPtr *) (memory + object + HEADER_SIZE);
+  for (i = 0; i < size; i++) {
+    field[i] = machine.nil;
+  }
+  return object;
+}
+
+
+ObjPtr createRawStackObject(ObjPtr class, int size) {
+  ObjPtr object;
+
+  /* the fields are undefined; since stack objects are roots */
+  /* of collections, the caller must set all of them before */
+  /* anything else is allocated */
+  if (size >= SIZE_OVERFLOW) {
+    sysError("createStackObject size too large");
+  }
+  object = (ObjPtr) stackTop;
+  stackTop += HEADER_SIZE + size * sizeof(ObjPtr);
+  writeClass(object, class);
+  writeInfo(object, size | HAS_POINTERS);
+  return object;
+}
+
+
+void reserveMemory(Word length) {
+  /* make sure that small objects with a total length of at */
+  /* most length bytes can be created without a collection */
+  if (nurseryFree + length > nurseryEnd) {
+    doGC(false);
+    if (nurseryFree + length > nurseryEnd) {
+      sysError("object memory exhausted");
+    }
   }
-  /* compute total size of all objects in bytes */
-  machine.memorySize = toFree - toStart;
 }
 
 
-/**************************************************************/
+ObjPtr moveToHeap(ObjPtr object) {
+  ObjPtr copy;
+  int size;
 
-/* interface */
+  /* copy an object of the stack zone into the heap */
+  size = readSize(object);
+  copy = createObject(readClass(object), size, true, false);
+  memcpy(memory + copy + HEADER_SIZE,
+         memory + object + HEADER_SIZE,
+         size * sizeof(ObjPtr));
+  /* the hash stays the same, if it has already been assigned */
+  writeInfo(copy, readInfo(copy) |
+                  (readInfo(object) & (HASH_MASK << HASH_SHIFT)));
+  if (!isYoungObject(copy)) {
+    rememberObject(copy);
+  }
+  return copy;
+}
 
 
-ObjPtr createObject(ObjPtr class, int size,
-                    Bool hasPtrs, Bool hasWords) {
-  static unsigned int fibHash = 314159265;
-  Word length;
-  ObjPtr object;
-  int i;
+void rememberObject(ObjPtr object) {
+  Word info;
 
-  /* compute length of object in bytes */
-  length = sizeof(ObjPtr) + sizeof(Word) + sizeof(Word);
-  if (hasPtrs) {
-    length += size * sizeof(ObjPtr);
-  } else {
-    if (hasWords) {
-      length += size * sizeof(Word);
-    } else {
-      length += size * sizeof(Byte);
-    }
+  /* only old objects with pointers need to be remembered */
+  if ((object & IS_SHORTINT) ||
+      isYoungObject(object) ||
+      isStackObject(object)) {
+    return;
   }
-  /* check if remaining space is large enough */
-  if (toFree + length > toEnd) {
-    /* not large enough, do a collection */
-    doGC();
-    /* ATTENTION: don't forget to update the class pointer! Since */
-    /* the class object must also be referenced elsewhere, we are */
-    /* sure that no object is actually copied in the process. */
-    class = updatePointer(class);
-    /* check for object memory overflow */
-    if (toFree + length > toEnd) {
-      sysError("object memory exhausted");
-    }
+  info = readInfo(object);
+  if ((info & HAS_POINTERS) == 0 ||
+      (info & REMEMBERED) != 0 ||
+      readSize(object) == 0) {
+    return;
   }
-  /* allocate the requested space */
-  object = (ObjPtr) toFree;
-  toFree += length;
-  /* satisfy alignment restrictions */
-  while (toFree & ALIGN_MASK) {
-    toFree++;
+  writeInfo(object, info | REMEMBERED);
+  if (numRemembered == maxRemembered) {
+    maxRemembered = maxRemembered == 0 ? 1024 : 2 * maxRemembered;
+    remembered = reallocate(remembered, maxRemembered * sizeof(ObjPtr));
   }
-  /* update allocation statistics */
-  if (debugMemory) {
-    numBytes += length;
-    numObjects++;
+  remembered[numRemembered++] = object;
+}
+
+
+ObjPtr forwardObject(ObjPtr object) {
+  /* the read barrier, see memory.h: answer the copy of an */
+  /* object in the "from" semispace, copying it if necessary, */
+  /* and mark a large object, so that it is scanned later */
+  if (object & IS_SHORTINT) {
+    return object;
   }
-  /* set class, hash and size; init fields */
-  writeClass(object, class);
-  writeHash(object, fibHash & ((1 << 30) - 1));
-  fibHash += 0x9E3779B9;  /* Fibonacci hashing, see Knuth Vol. 3 */
-  if (hasPtrs) {
-    writeSize(object, size | HAS_POINTERS);
-    /* ATTENTION: the following initialization is required! */
-    for (i = 0; i < size; i++) {
-      /* default object pointer value is nil */
-      writeObjPtr(object + sizeof(ObjPtr) + sizeof(Word) +
-                  sizeof(Word) + i * sizeof(ObjPtr), machine.nil);
-    }
-  } else {
-    if (hasWords) {
-      writeSize(object, size | HAS_WORDS);
-      /* ATTENTION: the following initialization is optional! */
-      for (i = 0; i < size; i++) {
-        /* default word value is 0 */
-        writeWord(object + sizeof(ObjPtr) + sizeof(Word) +
-                  sizeof(Word) + i * sizeof(Word), 0);
-      }
-    } else {
-      writeSize(object, size);
-      /* ATTENTION: the following initialization is optional! */
-      for (i = 0; i < size; i++) {
-        /* default byte value is 0 */
-        writeByte(object + sizeof(ObjPtr) + sizeof(Word) +
-                  sizeof(Word) + i * sizeof(Byte), 0);
-      }
-    }
+  if ((object >= fromStart && object < fromEnd) ||
+      isLargeObject(object)) {
+    return moveObject(object);
   }
-  /* return the object created just now */
   return object;
 }
 
@@ -371,7 +1841,7 @@ ObjPtr getClass(ObjPtr object) {
   if (object & IS_SHORTINT) {
     return machine.ShortInteger;
   } else {
-    return readClass(object);
+    return readBarrier(readClass(object));
   }
 }
 
@@ -381,15 +1851,32 @@ void setClass(ObjPtr object, ObjPtr class) {
     sysError("setClass object is short integer");
   }
   writeClass(object, class);
+  writeBarrier(object, class);
 }
 
 
 int getHash(ObjPtr object) {
+  static unsigned int fibHash = 314159265;
+  Word info;
+  Word hash;
+
   if (object & IS_SHORTINT) {
-    return object & ~IS_SHORTINT;
-  } else {
-    return readHash(object);
+    return (long) object >> SHORTINT_SHIFT;
+  }
+  /* most objects are never hashed, so the hash is assigned */
+  /* when it is asked for the first time; it doesn't depend */
+  /* on the address, and it is kept in the header, so that */
+  /* the object keeps it when it is moved */
+  info = readInfo(object);
+  hash = (info >> HASH_SHIFT) & HASH_MASK;
+  if (hash == 0) {
+    do {
+      hash = fibHash & HASH_MASK;
+      fibHash += 0x9E3779B9;  /* Fibonacci hashing, see Knuth Vol. 3 */
+    } while (hash == 0);
+    writeInfo(object, info | (hash << HASH_SHIFT));
   }
+  return hash;
 }
 
 
@@ -397,7 +1884,8 @@ void setHash(ObjPtr object, int hash) {
   if (object & IS_SHORTINT) {
     sysError("setHash object is short integer");
   }
-  writeHash(object, hash);
+  writeInfo(object, (readInfo(object) & ~(HASH_MASK << HASH_SHIFT)) |
+                    ((hash & HASH_MASK) << HASH_SHIFT));
 }
 
 
@@ -405,7 +1893,7 @@ int getSize(ObjPtr object) {
   if (object & IS_SHORTINT) {
     return 0;
   } else {
-    return readSize(object) & ~(HAS_POINTERS | HAS_WORDS);
+    return readSize(object);
   }
 }
 
@@ -414,7 +1902,7 @@ Bool hasPtrs(ObjPtr object) {
   if (object & IS_SHORTINT) {
     return false;
   } else {
-    return (readSize(object) & HAS_POINTERS) != 0;
+    return (readInfo(object) & HAS_POINTERS) != 0;
   }
 }
 
@@ -423,7 +1911,7 @@ Bool hasWords(ObjPtr object) {
   if (object & IS_SHORTINT) {
     return false;
   } else {
-    return (readSize(object) & HAS_WORDS) != 0;
+    return (readInfo(object) & HAS_WORDS) != 0;
   }
 }
 
@@ -432,13 +1920,33 @@ Bool hasBytes(ObjPtr object) {
   if (object & IS_SHORTINT) {
     return true;
   } else {
-    return (readSize(object) & (HAS_POINTERS | HAS_WORDS)) == 0;
+    return (readInfo(object) & (HAS_POINTERS | HAS_WORDS)) == 0;
   }
 }
 
 
 void *body(ObjPtr object) {
-  return memory + object + sizeof(ObjPtr) + sizeof(Word) + sizeof(Word);
+  return memory + object + HEADER_SIZE;
+}
+
+
+ObjPtr survivor(ObjPtr object) {
+  /* only valid between the end of a collection and the next */
+  /* allocation: answer the new address of an object which was */
+  /* moved by the collection, or nil if it was garbage */
+  if (object & IS_SHORTINT) {
+    return object;
+  }
+  if (!isCollected(object)) {
+    return object;
+  }
+  if (isLargeObject(object) && !collectPerm) {
+    return (readInfo(object) & MARKED) ? object : machine.nil;
+  }
+  if (readInfo(object) & BROKEN_HEART) {
+    return readClass(object);
+  }
+  return machine.nil;
 }
 
 
@@ -448,16 +1956,15 @@ ObjPtr getPtr(ObjPtr object, int index) {
   if (object & IS_SHORTINT) {
     sysError("getPtr object is short integer");
   }
-  size = readSize(object);
-  if ((size & HAS_POINTERS) == 0) {
+  if ((readInfo(object) & HAS_POINTERS) == 0) {
     sysError("getPtr object has no pointers");
   }
-  size &= ~HAS_POINTERS;
+  size = readSize(object);
   if (index >= size) {
     sysError("getPtr index out of range");
   }
-  return readObjPtr(object + sizeof(ObjPtr) + sizeof(Word) +
-                    sizeof(Word) + index * sizeof(ObjPtr));
+  return readBarrier(readObjPtr(object + HEADER_SIZE +
+                                index * sizeof(ObjPtr)));
 }
 
 
@@ -467,16 +1974,14 @@ Word getWord(ObjPtr object, int index) {
   if (object & IS_SHORTINT) {
     sysError("getWord object is short integer");
   }
-  size = readSize(object);
-  if ((size & HAS_WORDS) == 0) {
+  if ((readInfo(object) & HAS_WORDS) == 0) {
     sysError("getWord object has no words");
   }
-  size &= ~HAS_WORDS;
+  size = readSize(object);
   if (index >= size) {
     sysError("getWord index out of range");
   }
-  return readWord(object + sizeof(ObjPtr) + sizeof(Word) +
-                  sizeof(Word) + index * sizeof(Word));
+  return readWord(object + HEADER_SIZE + index * sizeof(Word));
 }
 
 
@@ -486,15 +1991,14 @@ Byte getByte(ObjPtr object, int index) {
   if (object & IS_SHORTINT) {
     sysError("getByte object is short integer");
   }
-  size = readSize(object);
-  if ((size & HAS_POINTERS) || (size & HAS_WORDS)) {
+  if (readInfo(object) & (HAS_POINTERS | HAS_WORDS)) {
     sysError("getByte object has no bytes");
   }
+  size = readSize(object);
   if (index >= size) {
     sysError("getByte index out of range");
   }
-  return readByte(object + sizeof(ObjPtr) + sizeof(Word) +
-                  sizeof(Word) + index * sizeof(Byte));
+  return readByte(object + HEADER_SIZE + index * sizeof(Byte));
 }
 
 
@@ -504,16 +2008,15 @@ void setPtr(ObjPtr object, int index, ObjPtr value) {
   if (object & IS_SHORTINT) {
     sysError("setPtr object is short integer");
   }
-  size = readSize(object);
-  if ((size & HAS_POINTERS) == 0) {
+  if ((readInfo(object) & HAS_POINTERS) == 0) {
     sysError("setPtr object has no pointers");
   }
-  size &= ~HAS_POINTERS;
+  size = readSize(object);
   if (index >= size) {
     sysError("setPtr index out of range");
   }
-  writeObjPtr(object + sizeof(ObjPtr) + sizeof(Word) +
-              sizeof(Word) + index * sizeof(ObjPtr), value);
+  writeObjPtr(object + HEADER_SIZE + index * sizeof(ObjPtr), value);
+  writeBarrier(object, value);
 }
 
 
@@ -523,16 +2026,14 @@ void setWord(ObjPtr object, int index, Word value) {
   if (object & IS_SHORTINT) {
     sysError("setWord object is short integer");
   }
-  size = readSize(object);
-  if ((size & HAS_WORDS) == 0) {
+  if ((readInfo(object) & HAS_WORDS) == 0) {
     sysError("setWord object has no words");
   }
-  size &= ~HAS_WORDS;
+  size = readSize(object);
   if (index >= size) {
     sysError("setWord index out of range");
   }
-  writeWord(object + sizeof(ObjPtr) + sizeof(Word) +
-            sizeof(Word) + index * sizeof(Word), value);
+  writeWord(object + HEADER_SIZE + index * sizeof(Word), value);
 }
 
 
@@ -542,46 +2043,505 @@ void setByte(ObjPtr object, int index, Byte value) {
   if (object & IS_SHORTINT) {
     sysError("setByte object is short integer");
   }
-  size = readSize(object);
-  if ((size & HAS_POINTERS) || (size & HAS_WORDS)) {
+  if (readInfo(object) & (HAS_POINTERS | HAS_WORDS)) {
     sysError("setByte object has no bytes");
   }
+  size = readSize(object);
   if (index >= size) {
     sysError("setByte index out of range");
   }
-  writeByte(object + sizeof(ObjPtr) + sizeof(Word) +
-            sizeof(Word) + index * sizeof(Byte), value);
+  writeByte(object + HEADER_SIZE + index * sizeof(Byte), value);
 }
 
 
-void initMemory(char *imageFileName) {
-  FILE *imageFile;
+/**************************************************************/
 
-  /* allocate object memory */
-  memory = allocate(MEMORY_SIZE * sizeof(Byte));
-  /* open image file */
-  imageFile = fopen(imageFileName, "rb");
-  if (imageFile == NULL) {
-    sysError("cannot open image file '%s' for read", imageFileName);
+/* image files */
+
+
+/*
+ * An image file starts with a header which describes the layout of
+ * the object memory following it: the byte order, the sizes of
+ * object pointers and words, the alignment of objects, the width of
+ * short integers, and the address of the first object. All numbers
+ * in the header are little-endian; the object pointers held by the
+ * machine are kept as eight-byte numbers, coded as in the objects.
+ *
+ * The object memory is the permanent space of the machine which
+ * wrote the image, as it was. A machine with the same layout maps
+ * or reads it without touching a single pointer. Any other machine
+ * reads it into a buffer and converts it in two linear passes over
+ * the objects, whose headers tell where all pointers are: the first
+ * computes the new address of every object and leaves it in place
+ * of the object's class, the second rewrites the objects into the
+ * permanent space, finding the new address of every pointer there.
+ */
+
+#define NUM_KNOWN_PTRS	((offsetof(Machine, newContext) - \
+			  offsetof(Machine, nil)) / sizeof(ObjPtr) + 1)
+#define NUM_MACHINE_PTRS	(NUM_KNOWN_PTRS + 2)
+#define IMAGE_HEADER_SIZE	(10 * 4 + 6 * 8 + NUM_MACHINE_PTRS * 8)
+
+
+typedef struct {
+  int bigEndian;		/* byte order of words and pointers */
+  int ptrSize;			/* size of an object pointer in bytes */
+  int wordSize;			/* size of a word in bytes */
+  int align;			/* alignment of objects in bytes */
+  int shortIntBits;		/* bits of a short integer, sign included */
+  Address permStart;		/* address of the first object */
+} Layout;
+
+
+static Layout hostLayout;	/* layout of our objects */
+static Layout fileLayout;	/* layout of the image being converted */
+static Byte *fileObjects;	/* its objects, in a buffer */
+static Word *fileClasses;	/* classes of the objects in the buffer */
+static long numFileClasses;	/* number of objects in the buffer */
+static long maxFileClasses;	/* capacity of the class list */
+
+
+static void getHostLayout(Layout *layout) {
+  Word one;
+
+  one = 1;
+  layout->bigEndian = *(Byte *) &one == 0;
+  layout->ptrSize = sizeof(ObjPtr);
+  layout->wordSize = sizeof(Word);
+  layout->align = ALIGN;
+  layout->shortIntBits = SHORTINT_BITS;
+  layout->permStart = stackEnd;
+}
+
+
+static ObjPtr *machinePtr(int i) {
+  /* the known objects and object registers of the machine */
+  /* lie next to each other, the compiler's do not */
+  if (i < NUM_KNOWN_PTRS) {
+    return &machine.nil + i;
+  }
+  return i == NUM_KNOWN_PTRS ? &machine.compilerMethod :
+                               &machine.compilerLiteral;
+}
+
+
+static Byte *putNumber(Byte *p, unsigned long long value, int size) {
+  while (size-- > 0) {
+    *p++ = value & 0xFF;
+    value >>= 8;
+  }
+  return p;
+}
+
+
+static unsigned long long getNumber(Byte **p, int size) {
+  unsigned long long value;
+  int i;
+
+  value = 0;
+  for (i = size - 1; i >= 0; i--) {
+    value = (value << 8) | (*p)[i];
+  }
+  *p += size;
+  return value;
+}
+
+
+Bool writeImageHeader(FILE *imageFile) {
+  Byte header[IMAGE_HEADER_SIZE];
+  Byte *p;
+  Layout layout;
+  int i;
+
+  /* write the header of an image file, describing the objects */
+  /* which are about to follow it */
+  getHostLayout(&layout);
+  p = header;
+  p = putNumber(p, SIGNATURE_1, 4);
+  p = putNumber(p, SIGNATURE_2, 4);
+  p = putNumber(p, MAJOR_VNUM, 4);
+  p = putNumber(p, MINOR_VNUM, 4);
+  p = putNumber(p, IMAGE_FORMAT, 4);
+  p = putNumber(p, layout.bigEndian, 4);
+  p = putNumber(p, layout.ptrSize, 4);
+  p = putNumber(p, layout.wordSize, 4);
+  p = putNumber(p, layout.align, 4);
+  p = putNumber(p, layout.shortIntBits, 4);
+  p = putNumber(p, layout.permStart, 8);
+  p = putNumber(p, machine.memoryStart, 8);
+  p = putNumber(p, machine.memorySize, 8);
+  p = putNumber(p, machine.compressedSize, 8);
+  p = putNumber(p, machine.ip, 8);
+  p = putNumber(p, machine.sp, 8);
+  for (i = 0; i < NUM_MACHINE_PTRS; i++) {
+    p = putNumber(p, *machinePtr(i), 8);
   }
-  /* read machine state */
-  if (fread(&machine, sizeof(Machine), 1, imageFile) != 1) {
+  return fwrite(header, 1, IMAGE_HEADER_SIZE, imageFile) ==
+         IMAGE_HEADER_SIZE;
+}
+
+
+static void readImageHeader(FILE *imageFile, char *imageFileName,
+                            Layout *layout,
+                            unsigned long long *ptrs) {
+  Byte header[IMAGE_HEADER_SIZE];
+  Byte *p;
+  int i;
+
+  /* read the header of an image file; the object pointers */
+  /* of the machine are left to the caller, coded as they are */
+  if (fread(header, 1, IMAGE_HEADER_SIZE, imageFile) != IMAGE_HEADER_SIZE) {
     sysError("cannot read machine state from image file");
   }
+  p = header;
   /* check image file signature */
-  if (machine.signature_1 != SIGNATURE_1 ||
-      machine.signature_2 != SIGNATURE_2) {
+  if (getNumber(&p, 4) != SIGNATURE_1 ||
+      getNumber(&p, 4) != SIGNATURE_2) {
     sysError("file '%s' is not an image file", imageFileName);
   }
   /* check image file version number (major only, minor ignored) */
-  if (machine.majorVersion != MAJOR_VNUM) {
+  if (getNumber(&p, 4) != MAJOR_VNUM) {
     sysError("wrong image file version number");
   }
-  /* load object memory */
-  if (fread(memory, sizeof(Byte), machine.memorySize, imageFile) !=
-      machine.memorySize) {
+  getNumber(&p, 4);
+  /* check object format of image file */
+  if (getNumber(&p, 4) != IMAGE_FORMAT) {
+    sysError("image file '%s' has a different object format",
+             imageFileName);
+  }
+  /* the layout of the objects may differ from ours, as long */
+  /* as the header words have the same bits */
+  layout->bigEndian = getNumber(&p, 4);
+  layout->ptrSize = getNumber(&p, 4);
+  layout->wordSize = getNumber(&p, 4);
+  layout->align = getNumber(&p, 4);
+  layout->shortIntBits = getNumber(&p, 4);
+  layout->permStart = getNumber(&p, 8);
+  if ((layout->ptrSize != 4 && layout->ptrSize != 8) ||
+      layout->wordSize != sizeof(Word) ||
+      layout->align < layout->wordSize ||
+      (layout->align & (layout->align - 1)) != 0 ||
+      layout->shortIntBits < 2 ||
+      layout->shortIntBits >= 8 * layout->ptrSize) {
+    sysError("image file '%s' has an unknown memory layout",
+             imageFileName);
+  }
+  machine.memoryStart = getNumber(&p, 8);
+  machine.memorySize = getNumber(&p, 8);
+  machine.compressedSize = getNumber(&p, 8);
+  machine.ip = getNumber(&p, 8);
+  machine.sp = getNumber(&p, 8);
+  for (i = 0; i < NUM_MACHINE_PTRS; i++) {
+    ptrs[i] = getNumber(&p, 8);
+  }
+}
+
+
+static unsigned long long fileNumber(Address offset, int size) {
+  Byte *p;
+  unsigned long long value;
+  int i;
+
+  /* read a word or pointer of the image being converted */
+  p = fileObjects + offset;
+  if (fileLayout.bigEndian) {
+    value = 0;
+    for (i = 0; i < size; i++) {
+      value = (value << 8) | p[i];
+    }
+    return value;
+  }
+  return getNumber(&p, size);
+}
+
+
+static Address fieldSize(Word info, int ptrSize, int wordSize) {
+  if (info & HAS_POINTERS) {
+    return ptrSize;
+  }
+  return info & HAS_WORDS ? wordSize : sizeof(Byte);
+}
+
+
+static Address sizeFileObjects(void) {
+  Address offset;
+  Address length;
+  Address total;
+  Word info;
+  Word size;
+  Word forward;
+  int ws;
+
+  /* first pass: compute the address of every object in the */
+  /* permanent space, and keep it in place of its class */
+  ws = fileLayout.wordSize;
+  numFileClasses = 0;
+  maxFileClasses = 0;
+  fileClasses = NULL;
+  offset = 0;
+  total = 0;
+  while (offset < machine.memorySize) {
+    if (offset + 2 * ws > machine.memorySize) {
+      sysError("image file is corrupt");
+    }
+    info = fileNumber(offset + ws, ws);
+    if ((info & SIZE_MASK) == SIZE_OVERFLOW) {
+      size = fileNumber(offset, ws);
+      offset += 2 * ws;
+      total += HEADER_SIZE;
+      if (offset + 2 * ws > machine.memorySize) {
+        sysError("image file is corrupt");
+      }
+      info = fileNumber(offset + ws, ws);
+    } else {
+      size = info & SIZE_MASK;
+    }
+    length = (2 * ws + size * fieldSize(info, fileLayout.ptrSize, ws) +
+              fileLayout.align - 1) & ~(Address) (fileLayout.align - 1);
+    if (offset + length > machine.memorySize) {
+      sysError("image file is corrupt");
+    }
+    if (numFileClasses == maxFileClasses) {
+      maxFileClasses = maxFileClasses == 0 ? 1024 : 2 * maxFileClasses;
+      fileClasses = reallocate(fileClasses, maxFileClasses * sizeof(Word));
+    }
+    fileClasses[numFileClasses++] = fileNumber(offset, ws);
+    forward = permStart + total;
+    memcpy(fileObjects + offset, &forward, sizeof(Word));
+    offset += length;
+    total += (HEADER_SIZE + size * fieldSize(info, sizeof(ObjPtr),
+                                              sizeof(Word)) +
+              ALIGN_MASK) & ~ALIGN_MASK;
+  }
+  return total;
+}
+
+
+static ObjPtr convertPointer(unsigned long long value) {
+  long long number;
+  Word forward;
+
+  /* short integers keep their value, if it fits; the value */
+  /* lies in the upper shortIntBits bits of the pointer */
+  if (value & IS_SHORTINT) {
+    number = (long long) (value << (64 - 8 * fileLayout.ptrSize)) >>
+             (64 - fileLayout.shortIntBits);
+    if (number < SHORTINT_MIN || number > SHORTINT_MAX) {
+      sysError("short integer %lld in image file is too large", number);
+    }
+    return newShortInteger(number);
+  }
+  /* object pointers are looked up in the header of the object */
+  if (value == 0) {
+    return 0;
+  }
+  if (value < fileLayout.permStart ||
+      value >= fileLayout.permStart + machine.memorySize) {
+    sysError("image file is corrupt");
+  }
+  memcpy(&forward, fileObjects + (value - fileLayout.permStart),
+         sizeof(Word));
+  return forward;
+}
+
+
+static void convertFileObjects(unsigned long long *ptrs) {
+  Address offset;
+  Address object;
+  Address length;
+  Word info;
+  Word size;
+  Word i;
+  int ws;
+  int ps;
+  long n;
+  Byte *body;
+  Byte b;
+
+  /* second pass: rewrite the objects into the permanent space */
+  for (i = 0; i < NUM_MACHINE_PTRS; i++) {
+    *machinePtr(i) = convertPointer(ptrs[i]);
+  }
+  ws = fileLayout.wordSize;
+  ps = fileLayout.ptrSize;
+  offset = 0;
+  object = permStart;
+  for (n = 0; n < numFileClasses; n++) {
+    info = fileNumber(offset + ws, ws);
+    if ((info & SIZE_MASK) == SIZE_OVERFLOW) {
+      size = fileNumber(offset, ws);
+      writeWord(object, size);
+      writeInfo(object, SIZE_OVERFLOW);
+      offset += 2 * ws;
+      object += HEADER_SIZE;
+      info = fileNumber(offset + ws, ws);
+    } else {
+      size = info & SIZE_MASK;
+    }
+    writeClass(object, convertPointer(fileClasses[n]));
+    writeInfo(object, info & ~(REMEMBERED | MARKED));
+    body = memory + object + HEADER_SIZE;
+    if (info & HAS_POINTERS) {
+      for (i = 0; i < size; i++) {
+        ((ObjPtr *) body)[i] =
+          convertPointer(fileNumber(offset + 2 * ws + i * ps, ps));
+      }
+    } else
+    if (info & HAS_WORDS) {
+      for (i = 0; i < size; i++) {
+        ((Word *) body)[i] = fileNumber(offset + 2 * ws + i * ws, ws);
+      }
+    } else {
+      memcpy(body, fileObjects + offset + 2 * ws, size);
+      /* floats are the only bytes which have a byte order */
+      if (readClass(object) == machine.Float &&
+          size == sizeof(double) &&
+          fileLayout.bigEndian != hostLayout.bigEndian) {
+        for (i = 0; i < size / 2; i++) {
+          b = body[i];
+          body[i] = body[size - 1 - i];
+          body[size - 1 - i] = b;
+        }
+      }
+    }
+    length = (2 * ws + size * fieldSize(info, ps, ws) +
+              fileLayout.align - 1) & ~(Address) (fileLayout.align - 1);
+    offset += length;
+    object += objectLength(object);
+  }
+}
+
+
+void initMemory(char *imageFileName) {
+  FILE *imageFile;
+  struct stat imageStat;
+  unsigned long long ptrs[NUM_MACHINE_PTRS];
+  Bool foreign;
+  int i;
+
+  /* check the sizes of the memory areas */
+  heapSize = (heapSize + ALIGN_MASK) & ~ALIGN_MASK;
+  nurserySize = (nurserySize + ALIGN_MASK) & ~ALIGN_MASK;
+  if (heapSize == 0) {
+    sysError("heap size must not be zero");
+  }
+  if (nurserySize < STACK_SIZE) {
+    sysError("nursery size must be at least %d bytes", STACK_SIZE);
+  }
+  /* the old space must leave room for a full nursery, */
+  /* and for the nurseries promoted during an incremental */
+  /* collection, which starts when it is half full */
+  if (heapSize < 2 * nurserySize) {
+    heapSize = 2 * nurserySize;
+  }
+  if (gcPauseMicros != 0 && heapSize < 8 * nurserySize) {
+    heapSize = 8 * nurserySize;
+  }
+  /* reserve memory for all spaces, the large-object */
+  /* space at the top of it is empty */
+  memory = mmap(NULL, MEMORY_LIMIT, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (memory == MAP_FAILED) {
+    sysError("cannot reserve object memory");
+  }
+  pageSize = sysconf(_SC_PAGESIZE);
+  largeStart = MEMORY_LIMIT;
+  largeEnd = MEMORY_LIMIT;
+  /* the stack zone lies at the bottom of memory and is empty */
+  stackStart = (Address) 0;
+  stackEnd = stackStart + (Address) STACK_SIZE * sizeof(Byte);
+  stackTop = stackStart;
+  /* open image file, snapshots are written to it, too */
+  imageName = imageFileName;
+  snapshotPid = 0;
+  lastSnapshot = SNAPSHOT_WRITTEN;
+  imageFile = fopen(imageFileName, "rb");
+  if (imageFile == NULL) {
+    sysError("cannot open image file '%s' for read", imageFileName);
+  }
+  /* read machine state, and the layout of the objects */
+  readImageHeader(imageFile, imageFileName, &fileLayout, ptrs);
+  getHostLayout(&hostLayout);
+  foreign = fileLayout.bigEndian != hostLayout.bigEndian ||
+            fileLayout.ptrSize != hostLayout.ptrSize ||
+            fileLayout.align != hostLayout.align ||
+            fileLayout.shortIntBits != hostLayout.shortIntBits ||
+            fileLayout.permStart != hostLayout.permStart;
+  imageConverted = foreign;
+  /* the image is loaded into the permanent space, which is */
+  /* followed by empty semispaces */
+  permStart = stackEnd;
+  if (fstat(fileno(imageFile), &imageStat) != 0 ||
+      imageStat.st_size < machine.memoryStart +
+                          (machine.compressedSize != 0 ?
+                             machine.compressedSize : machine.memorySize)) {
     sysError("cannot read objects from image file");
   }
+  if (foreign) {
+    /* objects of another layout are read into a buffer, */
+    /* and then converted into the permanent space */
+    imageMapped = false;
+    fileObjects = allocate(machine.memorySize + 1);
+    if (fseek(imageFile, machine.memoryStart, SEEK_SET) != 0) {
+      sysError("cannot read objects from image file");
+    }
+    if (machine.compressedSize != 0) {
+      if (!readCompressed(imageFile, fileObjects, machine.memorySize)) {
+        sysError("cannot expand objects from image file");
+      }
+    } else {
+      if (fread(fileObjects, sizeof(Byte), machine.memorySize,
+                imageFile) != machine.memorySize) {
+        sysError("cannot read objects from image file");
+      }
+    }
+    permEnd = permStart + sizeFileObjects();
+    if (permEnd > largeStart) {
+      sysError("object memory exhausted");
+    }
+    placeSpaces(heapSize);
+    convertFileObjects(ptrs);
+    machine.memorySize = permEnd - permStart;
+    release(fileObjects);
+    if (fileClasses != NULL) {
+      release(fileClasses);
+    }
+  } else {
+    for (i = 0; i < NUM_MACHINE_PTRS; i++) {
+      *machinePtr(i) = ptrs[i];
+    }
+    permEnd = permStart + (Address) machine.memorySize * sizeof(Byte);
+    placeSpaces(heapSize);
+    /* load object memory; if it starts on a page boundary in */
+    /* the file, it is mapped copy-on-write instead of read, */
+    /* so processes running the same image share the pages */
+    /* none of them writes to, and only touched pages are read; */
+    /* compressed object memory is expanded block by block */
+    imageMapped = machine.memorySize != 0 &&
+                  machine.compressedSize == 0 &&
+                  machine.memoryStart % pageSize == 0 &&
+                  permStart % pageSize == 0;
+    if (machine.compressedSize != 0) {
+      if (fseek(imageFile, machine.memoryStart, SEEK_SET) != 0 ||
+          !readCompressed(imageFile, memory + permStart,
+                          machine.memorySize)) {
+        sysError("cannot expand objects from image file");
+      }
+    } else
+    if (imageMapped) {
+      if (mmap(memory + permStart, machine.memorySize,
+               PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+               fileno(imageFile), machine.memoryStart) == MAP_FAILED) {
+        sysError("cannot map objects from image file");
+      }
+    } else {
+      if (fseek(imageFile, machine.memoryStart, SEEK_SET) != 0 ||
+          fread(memory + permStart, sizeof(Byte), machine.memorySize,
+                imageFile) != machine.memorySize) {
+        sysError("cannot read objects from image file");
+      }
+    }
+  }
   /* close image file */
   fclose(imageFile);
   /* init garbage collector */
@@ -589,27 +2549,125 @@ void initMemory(char *imageFileName) {
 }
 
 
-void exitMemory(char *imageFileName) {
+static void writeImage(char *imageFileName) {
+  char *tempFileName;
   FILE *imageFile;
 
-  /* exit garbage collector */
-  exitGC();
+  /* the image is written to a new file, which then replaces */
+  /* the old one, whose pages may still be mapped */
+  tempFileName = allocate(strlen(imageFileName) + 5);
+  sprintf(tempFileName, "%s.new", imageFileName);
   /* open image file */
-  imageFile = fopen(imageFileName, "wb");
+  imageFile = fopen(tempFileName, "wb");
   if (imageFile == NULL) {
-    sysError("cannot open image file '%s' for write", imageFileName);
+    sysError("cannot open image file '%s' for write", tempFileName);
   }
   /* write machine state */
-  if (fwrite(&machine, sizeof(Machine), 1, imageFile) != 1) {
+  machine.compressedSize = 0;
+  if (compressImage) {
+    machine.memoryStart = IMAGE_HEADER_SIZE;
+  } else {
+    machine.memoryStart = (IMAGE_HEADER_SIZE + IMAGE_ALIGN - 1) &
+                          ~(IMAGE_ALIGN - 1);
+  }
+  if (!writeImageHeader(imageFile)) {
     sysError("cannot write machine state to image file");
   }
-  /* save object memory */
-  if (fwrite(memory, sizeof(Byte), machine.memorySize, imageFile) !=
-      machine.memorySize) {
-    sysError("cannot write objects to image file");
+  if (compressImage) {
+    /* save object memory compressed, then complete the */
+    /* machine state with its size in the file */
+    machine.compressedSize = writeCompressed(imageFile, memory + toStart,
+                                             machine.memorySize);
+    if (machine.compressedSize < 0) {
+      sysError("cannot write objects to image file");
+    }
+    if (fseek(imageFile, 0, SEEK_SET) != 0 ||
+        !writeImageHeader(imageFile)) {
+      sysError("cannot write machine state to image file");
+    }
+  } else {
+    /* save object memory, page-aligned */
+    if (fseek(imageFile, machine.memoryStart, SEEK_SET) != 0 ||
+        fwrite(memory + toStart, sizeof(Byte), machine.memorySize,
+               imageFile) != machine.memorySize) {
+      sysError("cannot write objects to image file");
+    }
   }
   /* close image file */
-  fclose(imageFile);
+  if (fclose(imageFile) != 0) {
+    sysError("cannot write objects to image file");
+  }
+  if (rename(tempFileName, imageFileName) != 0) {
+    sysError("cannot replace image file '%s'", imageFileName);
+  }
+  release(tempFileName);
+}
+
+
+static void waitSnapshot(Bool block) {
+  int status;
+
+  /* collect the status of the process writing a snapshot, */
+  /* if it has exited or if we are told to wait for it */
+  if (snapshotPid == 0 ||
+      waitpid(snapshotPid, &status, block ? 0 : WNOHANG) == 0) {
+    return;
+  }
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    lastSnapshot = SNAPSHOT_WRITTEN;
+  } else {
+    lastSnapshot = SNAPSHOT_FAILED;
+  }
+  snapshotPid = 0;
+}
+
+
+void exitMemory(char *imageFileName) {
+  /* a snapshot must not be overtaken */
+  waitSnapshot(true);
+  /* exit garbage collector */
+  exitGC();
+  /* write the image */
+  writeImage(imageFileName);
   /* release object memory */
-  release(memory);
+  munmap(memory, MEMORY_LIMIT);
+  memory = NULL;
+}
+
+
+Bool startSnapshot(void) {
+  pid_t pid;
+
+  /* write the image in a child process, which sees a */
+  /* copy-on-write view of memory, while the caller goes */
+  /* on; only one snapshot is written at a time */
+  waitSnapshot(false);
+  if (snapshotPid != 0) {
+    return false;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  pid = fork();
+  if (pid < 0) {
+    return false;
+  }
+  if (pid == 0) {
+    /* the child compacts its copy of memory and writes it */
+    /* out silently; an error lets it exit with status 1 */
+    signal(SIGINT, SIG_IGN);
+    debugMemory = false;
+    completeContexts();
+    compactMemory();
+    writeImage(imageName);
+    _exit(0);
+  }
+  snapshotPid = pid;
+  return true;
+}
+
+
+int snapshotStatus(void) {
+  /* tell whether the last snapshot is still being written */
+  waitSnapshot(false);
+  return snapshotPid != 0 ? SNAPSHOT_RUNNING : lastSnapshot;
 }
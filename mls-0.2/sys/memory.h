@@ -7,19 +7,118 @@
 #define _MEMORY_H_
 
 
-/* two bits of the object pointer are used in coding short integers */
+/* short integers are tagged by the lowest bit of the object */
+/* pointer, which is clear in pointers to the aligned objects; */
+/* the value is kept above the lowest two bits, so that adding */
+/* two tagged values overflows just when the sum leaves the */
+/* SHORTINT_BITS bits of a short integer */
 
-#define IS_SHORTINT		OBJPTR_MSB
-#define IS_NEGATIVE		OBJPTR_NSB
+#define IS_SHORTINT		1
+#define SHORTINT_SHIFT		2
+#define SHORTINT_BITS		(8 * sizeof(ObjPtr) - SHORTINT_SHIFT)
+#define SHORTINT_MIN		(-((long) 1 << (SHORTINT_BITS - 1)))
+#define SHORTINT_MAX		(((long) 1 << (SHORTINT_BITS - 1)) - 1)
 
 
+/* every object starts with a header of two words: the class, */
+/* and the flags, hash, and size of the object packed together; */
+/* classes are kept as 32-bit offsets, which limits the object */
+/* memory to 4 GB */
+
+#define HEADER_SIZE		(sizeof(Word) + sizeof(Word))
+
+
+/* while an incremental collection is in progress, the machine */
+/* must only see objects which have been copied or marked by it; */
+/* every pointer loaded from an object passes this read barrier */
+
+#define readBarrier(p)		(gcCycle ? forwardObject(p) : (p))
+
+
+/* unchecked access to the fields of objects, for use by the */
+/* threaded interpreter only: the caller guarantees that the */
+/* object is not a short integer and that the index is valid */
+
+#define fastBody(o)		((void *) (memory + (o) + HEADER_SIZE))
+#define fastClass(o)		readBarrier((ObjPtr) *(Word *) (memory + (o)))
+#define fastGetPtr(o, i)	readBarrier(((ObjPtr *) fastBody(o))[i])
+#define fastSetPtr(o, i, v)	(((ObjPtr *) fastBody(o))[i] = (v))
+#define fastGetWord(o, i)	(((Word *) fastBody(o))[i])
+
+
+/* method contexts which have not escaped live in a stack zone */
+/* below both semispaces, which is not subject to collections */
+
+#define isStackObject(o)	((Address) (o) >= stackStart && \
+				 (Address) (o) < stackEnd)
+
+
+/* the objects loaded from the image live in a permanent space */
+/* between the stack zone and the semispaces, which is only */
+/* collected when the image is saved; new objects are allocated */
+/* in a nursery above the semispaces, large ones in a space of */
+/* their own at the top of memory; stores of young objects into */
+/* old objects and of any other heap objects into permanent */
+/* objects must be remembered, setPtr does this on its own */
+
+#define isPermObject(o)		((Address) (o) >= permStart && \
+				 (Address) (o) < permEnd)
+
+#define isHeapObject(o)		((Address) (o) >= permEnd && \
+				 (Address) (o) < largeEnd)
+
+#define isLargeObject(o)	((Address) (o) >= largeStart && \
+				 (Address) (o) < largeEnd)
+
+#define isYoungObject(o)	((Address) (o) >= nurseryStart && \
+				 (Address) (o) < nurseryEnd)
+
+#define writeBarrier(o, v) \
+  do { \
+    if (isYoungObject(v) || \
+        (isPermObject(o) && isHeapObject(v))) { \
+      rememberObject(o); \
+    } \
+  } while (0)
+
+
+#define SNAPSHOT_RUNNING	0	/* a snapshot is being written */
+#define SNAPSHOT_WRITTEN	1	/* the last snapshot was written */
+#define SNAPSHOT_FAILED		2	/* the last snapshot failed */
+
+
+extern Byte *memory;		/* object memory where all objects live */
+extern Address stackStart;	/* base of stack zone in memory */
+extern Address stackEnd;	/* top of stack zone in memory */
+extern Address stackTop;	/* address of first free byte in stack zone */
+extern Address permStart;	/* base of permanent space in memory */
+extern Address permEnd;		/* top of permanent space in memory */
+extern Address nurseryStart;	/* base of nursery in memory */
+extern Address nurseryEnd;	/* top of nursery in memory */
+extern Address largeStart;	/* base of large-object space in memory */
+extern Address largeEnd;	/* top of large-object space in memory */
 extern Bool debugMemory;	/* debug flag, give statistics if set */
 extern Bool enableGC;		/* enables garbage collections if set */
+extern Word heapSize;		/* initial and minimal size of a semispace */
+extern Word nurserySize;	/* size of the nursery */
+extern int gcThreads;		/* number of threads used by the GC */
+extern Word gcPauseMicros;	/* pause target of incremental collections */
+extern Bool gcCycle;		/* incremental collection in progress */
+extern Bool compressImage;	/* write the image compressed if set */
 
 
 ObjPtr createObject(ObjPtr class, int size,
                     Bool hasPtrs, Bool hasWords);
 
+ObjPtr createRawObject(ObjPtr class, int size, Bool hasWords);
+
+ObjPtr createStackObject(ObjPtr class, int size);
+ObjPtr createRawStackObject(ObjPtr class, int size);
+void reserveMemory(Word length);
+ObjPtr moveToHeap(ObjPtr object);
+void rememberObject(ObjPtr object);
+ObjPtr forwardObject(ObjPtr object);
+
 ObjPtr getClass(ObjPtr object);
 void setClass(ObjPtr object, ObjPtr class);
 
@@ -33,6 +132,7 @@ Bool hasWords(ObjPtr object);
 Bool hasBytes(ObjPtr object);
 
 void *body(ObjPtr object);
+ObjPtr survivor(ObjPtr object);
 
 ObjPtr getPtr(ObjPtr object, int index);
 Word getWord(ObjPtr object, int index);
@@ -44,6 +144,9 @@ void setByte(ObjPtr object, int index, Byte value);
 
 void initMemory(char *imageFileName);
 void exitMemory(char *imageFileName);
+Bool writeImageHeader(FILE *imageFile);
+Bool startSnapshot(void);
+int snapshotStatus(void);
 
 
 #endif /* _MEMORY_H_ */
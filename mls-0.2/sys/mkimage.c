@@ -42,13 +42,10 @@ static void createImageFile(char *imageFileName) {
     sysError("cannot create image file '%s'", imageFileName);
   }
   /* write initial machine state */
-  machine.signature_1 = SIGNATURE_1;
-  machine.signature_2 = SIGNATURE_2;
-  machine.majorVersion = MAJOR_VNUM;
-  machine.minorVersion = MINOR_VNUM;
-  machine.memoryStart = sizeof(Machine);
+  machine.memoryStart = 0;
   machine.memorySize = 0;
-  if (fwrite(&machine, sizeof(Machine), 1, imageFile) != 1) {
+  machine.compressedSize = 0;
+  if (!writeImageHeader(imageFile)) {
     sysError("cannot write initial machine state");
   }
   /* close image file */
@@ -193,6 +190,8 @@ static ObjPtr Method(ObjPtr text,
                      ObjPtr argSize,
                      ObjPtr tempSize,
                      ObjPtr stackSize,
+                     ObjPtr primitive,
+                     ObjPtr quick,
                      ObjPtr whereClass) {
   ObjPtr class;
   ObjPtr method;
@@ -206,6 +205,8 @@ static ObjPtr Method(ObjPtr text,
   setPtr(method, ARGSIZE_IN_METHOD, argSize);
   setPtr(method, TEMPSIZE_IN_METHOD, tempSize);
   setPtr(method, STACKSIZE_IN_METHOD, stackSize);
+  setPtr(method, PRIMITIVE_IN_METHOD, primitive);
+  setPtr(method, QUICK_IN_METHOD, quick);
   setPtr(method, CLASS_IN_METHOD, whereClass);
   return method;
 }
@@ -653,6 +654,8 @@ static struct {
 } knownClasses[] = {
   { "ShortInteger",  &machine.ShortInteger  },
   { "Float",         &machine.Float         },
+  { "LargePositiveInteger", &machine.LargePositiveInteger },
+  { "LargeNegativeInteger", &machine.LargeNegativeInteger },
   { "Character",     &machine.Character     },
   { "String",        &machine.String        },
   { "Symbol",        &machine.Symbol        },
@@ -680,6 +683,11 @@ static void storeKnownClasses(void) {
 /**************************************************************/
 
 
+static int numMethods = 0;	/* methods compiled */
+static int numQuick = 0;	/* methods executed in place */
+static int numPrimitive = 0;	/* methods calling a primitive only */
+
+
 static Bool readMethodDefs(char *tokens[], int numTokens,
                            FILE *classFile, Bool forMetaclass) {
   char methodSource[METHOD_SIZE];
@@ -732,6 +740,13 @@ static Bool readMethodDefs(char *tokens[], int numTokens,
     if (!compile(methodSource, targetClass, false)) {
       return false;
     }
+    numMethods++;
+    if (getPtr(machine.compilerMethod, QUICK_IN_METHOD) != machine.nil) {
+      numQuick++;
+    }
+    if (getPtr(machine.compilerMethod, PRIMITIVE_IN_METHOD) != machine.nil) {
+      numPrimitive++;
+    }
     /* finally, install method */
     enter(getPtr(targetClass, METHODS_IN_BEHAVIOR),
           getPtr(machine.compilerMethod, SELECTOR_IN_METHOD),
@@ -843,6 +858,8 @@ static void createInitialContext(void) {
                   newShortInteger(0),
                   newShortInteger(0),
                   newShortInteger(1),
+                  machine.nil,
+                  machine.nil,
                   findClassObject("SystemDictionary"));
   /* then, the context */
   context = MethodContext(machine.nil,
@@ -882,6 +899,10 @@ static void help(char *myself) {
   printf("Options:\n");
   printf("  --image <image file>    set image file name\n");
   printf("  --memory                show memory statistics\n");
+  printf("  --heap <size>           set initial size of a semispace,\n");
+  printf("                          in bytes, or with suffix K or M\n");
+  printf("  --nursery <size>        set size of the nursery\n");
+  printf("  --compress              write a compressed image\n");
   printf("  --filein                show file-in details\n");
   printf("  --source                show source given to compiler\n");
   printf("  --tokens                show token stream within compiler\n");
@@ -916,6 +937,27 @@ int main(int argc, char *argv[]) {
       if (strcmp(argv[i], "--memory") == 0) {
         debugMemory = true;
       } else
+      if (strcmp(argv[i], "--heap") == 0) {
+        if (i == argc - 1) {
+          sysError("no heap size specified");
+        }
+        heapSize = parseSize(argv[++i]);
+        if (heapSize == 0) {
+          sysError("illegal heap size '%s'", argv[i]);
+        }
+      } else
+      if (strcmp(argv[i], "--nursery") == 0) {
+        if (i == argc - 1) {
+          sysError("no nursery size specified");
+        }
+        nurserySize = parseSize(argv[++i]);
+        if (nurserySize == 0) {
+          sysError("illegal nursery size '%s'", argv[i]);
+        }
+      } else
+      if (strcmp(argv[i], "--compress") == 0) {
+        compressImage = true;
+      } else
       if (strcmp(argv[i], "--filein") == 0) {
         debugFileIn = true;
       } else
@@ -993,6 +1035,8 @@ int main(int argc, char *argv[]) {
     }
     fclose(classFile);
   }
+  printf("%d methods compiled, %d quick, %d primitive\n",
+         numMethods, numQuick, numPrimitive);
   /* create the initial context */
   createInitialContext();
   /* exit object memory */
@@ -9,6 +9,7 @@
 #include <signal.h>
 
 #include "common.h"
+#include "utils.h"
 #include "machine.h"
 #include "memory.h"
 #include "filein.h"
@@ -43,8 +44,17 @@ static void help(char *myself) {
   printf("Usage: %s [options]\n", myself);
   printf("Options:\n");
   printf("  --image <image file>    set image file name\n");
-  printf("  --debug                 start virtual machine in debug mode\n");
+  printf("  --debug                 start virtual machine in debug mode,\n");
+  printf("                          using the checked interpreter\n");
   printf("  --memory                show memory statistics\n");
+  printf("  --heap <size>           set initial size of a semispace,\n");
+  printf("                          in bytes, or with suffix K or M\n");
+  printf("  --nursery <size>        set size of the nursery\n");
+  printf("  --gc-threads <n>        use n threads for major collections\n");
+  printf("  --gc-pause-us <n>       collect incrementally, in pauses\n");
+  printf("                          of about n microseconds\n");
+  printf("  --compress              write a compressed image\n");
+  printf("  --stats                 show virtual machine statistics\n");
   printf("  --filein                show file-in details\n");
   printf("  --source                show source given to compiler\n");
   printf("  --tokens                show token stream within compiler\n");
@@ -78,6 +88,48 @@ int main(int argc, char *argv[]) {
       if (strcmp(argv[i], "--memory") == 0) {
         debugMemory = true;
       } else
+      if (strcmp(argv[i], "--heap") == 0) {
+        if (i == argc - 1) {
+          sysError("no heap size specified");
+        }
+        heapSize = parseSize(argv[++i]);
+        if (heapSize == 0) {
+          sysError("illegal heap size '%s'", argv[i]);
+        }
+      } else
+      if (strcmp(argv[i], "--nursery") == 0) {
+        if (i == argc - 1) {
+          sysError("no nursery size specified");
+        }
+        nurserySize = parseSize(argv[++i]);
+        if (nurserySize == 0) {
+          sysError("illegal nursery size '%s'", argv[i]);
+        }
+      } else
+      if (strcmp(argv[i], "--gc-threads") == 0) {
+        if (i == argc - 1) {
+          sysError("no number of GC threads specified");
+        }
+        gcThreads = atoi(argv[++i]);
+        if (gcThreads < 1) {
+          sysError("illegal number of GC threads '%s'", argv[i]);
+        }
+      } else
+      if (strcmp(argv[i], "--gc-pause-us") == 0) {
+        if (i == argc - 1) {
+          sysError("no GC pause target specified");
+        }
+        if (atoi(argv[i + 1]) < 1) {
+          sysError("illegal GC pause target '%s'", argv[i + 1]);
+        }
+        gcPauseMicros = atoi(argv[++i]);
+      } else
+      if (strcmp(argv[i], "--compress") == 0) {
+        compressImage = true;
+      } else
+      if (strcmp(argv[i], "--stats") == 0) {
+        statsMachine = true;
+      } else
       if (strcmp(argv[i], "--filein") == 0) {
         debugFileIn = true;
       } else
@@ -117,6 +169,9 @@ int main(int argc, char *argv[]) {
   enableGC = true;
   initMemory(imageFileName);
   run();
+  if (statsMachine) {
+    showStatistics();
+  }
   exitMemory(imageFileName);
   printf("Bye...\n");
   return 0;
@@ -14,21 +14,20 @@
 #include "memory.h"
 
 
-ObjPtr newShortInteger(int value) {
-  return value | IS_SHORTINT;
+ObjPtr newShortInteger(long value) {
+  return ((ObjPtr) value << SHORTINT_SHIFT) | IS_SHORTINT;
 }
 
 
-int getShortInteger(ObjPtr object) {
-  return object & IS_NEGATIVE ?
-         object : object & ~IS_SHORTINT;
+long getShortInteger(ObjPtr object) {
+  return (long) object >> SHORTINT_SHIFT;
 }
 
 
 ObjPtr newFloat(double value) {
   ObjPtr object;
 
-  object = createObject(machine.Float, sizeof(double), false, false);
+  object = createRawObject(machine.Float, sizeof(double), false);
   *(double *)body(object) = value;
   return object;
 }
@@ -54,7 +53,7 @@ ObjPtr newString(char *string) {
   ObjPtr object;
 
   n = strlen(string);
-  object = createObject(machine.String, n, false, false);
+  object = createRawObject(machine.String, n, false);
   memcpy(body(object), string, n);
   return object;
 }
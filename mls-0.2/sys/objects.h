@@ -71,12 +71,14 @@
 #define ARGSIZE_IN_METHOD		4
 #define TEMPSIZE_IN_METHOD		5
 #define STACKSIZE_IN_METHOD		6
-#define CLASS_IN_METHOD			7
-#define SIZE_OF_METHOD			8
+#define PRIMITIVE_IN_METHOD		7
+#define QUICK_IN_METHOD			8
+#define CLASS_IN_METHOD			9
+#define SIZE_OF_METHOD			10
 
 
-ObjPtr newShortInteger(int value);
-int getShortInteger(ObjPtr object);
+ObjPtr newShortInteger(long value);
+long getShortInteger(ObjPtr object);
 ObjPtr newFloat(double value);
 double getFloat(ObjPtr object);
 ObjPtr newCharacter(Byte value);
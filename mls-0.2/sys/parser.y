@@ -330,7 +330,7 @@ primary			: IDENT
 
 literal			: INTLIT
 			  {
-			    $$ = mkInt($1.line, $1.val);
+			    $$ = mkInt($1.line, $1.val, $1.digits);
 			  }
 			| FLTLIT
 			  {
@@ -386,7 +386,7 @@ elements		: /* empty */
 			  }
 			| INTLIT elements
 			  {
-			    $$ = mkList(mkInt($1.line, $1.val), $2);
+			    $$ = mkList(mkInt($1.line, $1.val, $1.digits), $2);
 			  }
 			| FLTLIT elements
 			  {
@@ -12,6 +12,7 @@
 #include "prims.h"
 #include "objects.h"
 #include "memory.h"
+#include "largeint.h"
 #include "compiler.h"
 #include "ui.h"
 
@@ -38,6 +39,38 @@ static void prim007(int numArgs, int primNum) {
 }
 
 
+static void prim008(int numArgs, int primNum) {
+  /* SystemDictionary >> snapshot */
+  checkNumArgs(0, numArgs, primNum);
+  /* this is the answer when the snapshot is resumed */
+  push(machine.nil);
+  if (startSnapshot()) {
+    pop();
+    push(machine.true);
+  } else {
+    pop();
+    push(machine.false);
+  }
+}
+
+
+static void prim009(int numArgs, int primNum) {
+  /* SystemDictionary >> snapshotDone */
+  checkNumArgs(0, numArgs, primNum);
+  switch (snapshotStatus()) {
+    case SNAPSHOT_RUNNING:
+      push(machine.nil);
+      break;
+    case SNAPSHOT_WRITTEN:
+      push(machine.true);
+      break;
+    default:
+      push(machine.false);
+      break;
+  }
+}
+
+
 static void prim011(int numArgs, int primNum) {
   /* Object >> class */
   checkNumArgs(1, numArgs, primNum);
@@ -114,7 +147,7 @@ static void prim023(int numArgs, int primNum) {
 
 static void prim024(int numArgs, int primNum) {
   ObjPtr string1, string2;
-  int size1, size2, i, j;
+  int size1, size2;
   ObjPtr result;
 
   /* String >> , */
@@ -123,20 +156,17 @@ static void prim024(int numArgs, int primNum) {
   size2 = getSize(string2);
   string1 = pop();
   size1 = getSize(string1);
+  if (!hasBytes(string1) || !hasBytes(string2)) {
+    sysError("primitive %d was called with an object which has no bytes",
+             primNum);
+  }
   push(string2);
   push(string1);
-  result = createObject(machine.String, size1 + size2, false, false);
-  j = 0;
+  result = createRawObject(machine.String, size1 + size2, false);
   string1 = pop();
-  for (i = 0; i < size1; i++) {
-    setByte(result, j, getByte(string1, i));
-    j++;
-  }
+  memcpy(body(result), body(string1), size1);
   string2 = pop();
-  for (i = 0; i < size2; i++) {
-    setByte(result, j, getByte(string2, i));
-    j++;
-  }
+  memcpy((Byte *) body(result) + size1, body(string2), size2);
   push(result);
 }
 
@@ -221,6 +251,30 @@ static void prim030(int numArgs, int primNum) {
 }
 
 
+static void prim031(int numArgs, int primNum) {
+  ObjPtr class;
+
+  /* Behavior >> flushCache */
+  checkNumArgs(1, numArgs, primNum);
+  class = pop();
+  flushMethodCache();
+  push(class);
+}
+
+
+static void prim032(int numArgs, int primNum) {
+  ObjPtr selector;
+  ObjPtr class;
+
+  /* Behavior >> flushCache: */
+  checkNumArgs(2, numArgs, primNum);
+  selector = pop();
+  class = pop();
+  flushSelector(selector);
+  push(class);
+}
+
+
 static void prim035(int numArgs, int primNum) {
   int index;
   ObjPtr object;
@@ -302,57 +356,96 @@ static void prim057(int numArgs, int primNum) {
 
 
 static void prim060(int numArgs, int primNum) {
-  int op1, op2;
+  ObjPtr op1, op2;
+  ObjPtr result;
 
-  /* ShortInteger >> + */
+  /* Integer >> + */
   checkNumArgs(2, numArgs, primNum);
-  op2 = getShortInteger(pop());
-  op1 = getShortInteger(pop());
-  push(newShortInteger(op1 + op2));
+  op2 = pop();
+  op1 = pop();
+  if ((op1 & op2 & IS_SHORTINT) && addShortIntegers(op1, op2, &result)) {
+    push(result);
+  } else {
+    push(addIntegers(op1, op2));
+  }
 }
 
 
 static void prim061(int numArgs, int primNum) {
-  int op1, op2;
+  ObjPtr op1, op2;
+  ObjPtr result;
 
-  /* ShortInteger >> - */
+  /* Integer >> - */
   checkNumArgs(2, numArgs, primNum);
-  op2 = getShortInteger(pop());
-  op1 = getShortInteger(pop());
-  push(newShortInteger(op1 - op2));
+  op2 = pop();
+  op1 = pop();
+  if ((op1 & op2 & IS_SHORTINT) && subtractShortIntegers(op1, op2, &result)) {
+    push(result);
+  } else {
+    push(subtractIntegers(op1, op2));
+  }
+}
+
+
+static void prim062(int numArgs, int primNum) {
+  ObjPtr op1, op2;
+
+  /* LargeInteger >> = */
+  checkNumArgs(2, numArgs, primNum);
+  op2 = pop();
+  op1 = pop();
+  if (isInteger(op2) && compareIntegers(op1, op2) == 0) {
+    push(machine.true);
+  } else {
+    push(machine.false);
+  }
 }
 
 
 static void prim067(int numArgs, int primNum) {
-  int op1, op2;
+  ObjPtr op1, op2;
 
-  /* ShortInteger >> \\ */
+  /* Integer >> \\ */
   checkNumArgs(2, numArgs, primNum);
-  op2 = getShortInteger(pop());
-  op1 = getShortInteger(pop());
-  push(newShortInteger(op1 % op2));
+  op2 = pop();
+  op1 = pop();
+  if ((op1 & op2 & IS_SHORTINT) && op2 != newShortInteger(0)) {
+    push(newShortInteger(getShortInteger(op1) % getShortInteger(op2)));
+  } else {
+    push(remainderIntegers(op1, op2));
+  }
 }
 
 
 static void prim068(int numArgs, int primNum) {
-  int op1, op2;
+  ObjPtr op1, op2;
+  ObjPtr result;
 
-  /* ShortInteger >> * */
+  /* Integer >> * */
   checkNumArgs(2, numArgs, primNum);
-  op2 = getShortInteger(pop());
-  op1 = getShortInteger(pop());
-  push(newShortInteger(op1 * op2));
+  op2 = pop();
+  op1 = pop();
+  if ((op1 & op2 & IS_SHORTINT) && multiplyShortIntegers(op1, op2, &result)) {
+    push(result);
+  } else {
+    push(multiplyIntegers(op1, op2));
+  }
 }
 
 
 static void prim069(int numArgs, int primNum) {
-  int op1, op2;
+  ObjPtr op1, op2;
 
-  /* ShortInteger >> // */
+  /* Integer >> // */
   checkNumArgs(2, numArgs, primNum);
-  op2 = getShortInteger(pop());
-  op1 = getShortInteger(pop());
-  push(newShortInteger(op1 / op2));
+  op2 = pop();
+  op1 = pop();
+  if ((op1 & op2 & IS_SHORTINT) && op2 != newShortInteger(0)) {
+    /* only SHORTINT_MIN // -1 leaves the short integers */
+    push(newInteger(getShortInteger(op1) / getShortInteger(op2)));
+  } else {
+    push(divideIntegers(op1, op2));
+  }
 }
 
 
@@ -440,29 +533,41 @@ static void prim134(int numArgs, int primNum) {
 
 
 static void prim251(int numArgs, int primNum) {
-  int op1, op2;
+  ObjPtr op1, op2;
+  Bool less;
 
-  /* ShortInteger >> <= */
+  /* Integer >> < */
   checkNumArgs(2, numArgs, primNum);
-  op2 = getShortInteger(pop());
-  op1 = getShortInteger(pop());
-  push(op1 < op2 ? machine.true : machine.false);
+  op2 = pop();
+  op1 = pop();
+  if (op1 & op2 & IS_SHORTINT) {
+    less = (long) op1 < (long) op2;
+  } else {
+    less = compareIntegers(op1, op2) < 0;
+  }
+  push(less ? machine.true : machine.false);
 }
 
 
 static void prim252(int numArgs, int primNum) {
-  int op1, op2;
+  ObjPtr op1, op2;
+  Bool lessOrEqual;
 
-  /* ShortInteger >> <= */
+  /* Integer >> <= */
   checkNumArgs(2, numArgs, primNum);
-  op2 = getShortInteger(pop());
-  op1 = getShortInteger(pop());
-  push(op1 <= op2 ? machine.true : machine.false);
+  op2 = pop();
+  op1 = pop();
+  if (op1 & op2 & IS_SHORTINT) {
+    lessOrEqual = (long) op1 <= (long) op2;
+  } else {
+    lessOrEqual = compareIntegers(op1, op2) <= 0;
+  }
+  push(lessOrEqual ? machine.true : machine.false);
 }
 
 
 static void prim253(int numArgs, int primNum) {
-  int op1, op2;
+  long op1, op2;
 
   /* ShortInteger >> bitAnd: */
   checkNumArgs(2, numArgs, primNum);
@@ -473,7 +578,7 @@ static void prim253(int numArgs, int primNum) {
 
 
 static void prim254(int numArgs, int primNum) {
-  int op1, op2;
+  long op1, op2;
 
   /* ShortInteger >> bitOr: */
   checkNumArgs(2, numArgs, primNum);
@@ -484,7 +589,7 @@ static void prim254(int numArgs, int primNum) {
 
 
 static void prim255(int numArgs, int primNum) {
-  int op1, op2;
+  long op1, op2;
 
   /* ShortInteger >> bitXor: */
   checkNumArgs(2, numArgs, primNum);
@@ -499,13 +604,13 @@ typedef void (*Prim)(int numArgs, int primNum);
 
 static Prim primTbl[256] = {
   illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, prim007,
-  illPrim, illPrim, illPrim, prim011, prim012, prim013, illPrim, illPrim,
+  prim008, prim009, illPrim, prim011, prim012, prim013, illPrim, illPrim,
   illPrim, illPrim, illPrim, illPrim, prim020, prim021, prim022, prim023,
-  prim024, prim025, prim026, prim027, illPrim, prim029, prim030, illPrim,
-  illPrim, illPrim, illPrim, prim035, prim036, prim037, illPrim, prim039,
+  prim024, prim025, prim026, prim027, illPrim, prim029, prim030, prim031,
+  prim032, illPrim, illPrim, prim035, prim036, prim037, illPrim, prim039,
   illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, illPrim,
   illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, illPrim,
-  prim056, prim057, illPrim, illPrim, prim060, prim061, illPrim, illPrim,
+  prim056, prim057, illPrim, illPrim, prim060, prim061, prim062, illPrim,
   illPrim, illPrim, illPrim, prim067, prim068, prim069, illPrim, illPrim,
   illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, illPrim,
   illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, illPrim, illPrim,
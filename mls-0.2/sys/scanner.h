@@ -13,7 +13,8 @@ typedef struct {
 
 typedef struct {
   int line;
-  int val;
+  long val;
+  char *digits;		/* the literal, if val cannot hold it */
 } IntVal;
 
 typedef struct {
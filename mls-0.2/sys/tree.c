@@ -101,13 +101,14 @@ Node *mkVar(int line, char *name) {
 }
 
 
-Node *mkInt(int line, int val) {
+Node *mkInt(int line, long val, char *digits) {
   Node *node;
 
   node = allocate(sizeof(Node));
   node->type = Int;
   node->line = line;
   node->u.intNode.val = val;
+  node->u.intNode.digits = digits;
   return node;
 }
 
@@ -208,8 +209,8 @@ static void say(char *s) {
 }
 
 
-static void sayInt(int i) {
-  printf("%d", i);
+static void sayInt(long i) {
+  printf("%ld", i);
 }
 
 
@@ -327,7 +328,11 @@ static void showVar(Node *node, int n) {
 static void showInt(Node *node, int n) {
   indent(n);
   say("Int(");
-  sayInt(node->u.intNode.val);
+  if (node->u.intNode.digits != NULL) {
+    say(node->u.intNode.digits);
+  } else {
+    sayInt(node->u.intNode.val);
+  }
   say(")");
 }
 
@@ -69,7 +69,8 @@ typedef struct node {
       Variable *var;
     } varNode;
     struct {
-      int val;
+      long val;
+      char *digits;	/* the literal, if val cannot hold it */
     } intNode;
     struct {
       double val;
@@ -114,7 +115,7 @@ Node *mkCascade(int line, Node *receiver, List *continuations);
 Node *mkMessage(int line, char *selector,
                 Node *receiver, List *arguments);
 Node *mkVar(int line, char *name);
-Node *mkInt(int line, int val);
+Node *mkInt(int line, long val, char *digits);
 Node *mkFloat(int line, double val);
 Node *mkChar(int line, char val);
 Node *mkString(int line, char *val);
@@ -10,7 +10,7 @@
 extern Bool compilationOK;
 
 
-void sysError(char *fmt, ...);
+void sysError(char *fmt, ...) __attribute__((noreturn));
 void sysWarning(char *fmt, ...);
 void compError(char *fmt, ...);
 void compWarning(char *fmt, ...);
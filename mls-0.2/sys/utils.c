@@ -23,6 +23,15 @@ void *allocate(unsigned int size) {
 }
 
 
+void *reallocate(void *p, unsigned int size) {
+  p = realloc(p, size);
+  if (p == NULL) {
+    sysError("out of memory");
+  }
+  return p;
+}
+
+
 void release(void *p) {
   if (p == NULL) {
     sysError("NULL pointer detected in release");
@@ -43,5 +52,32 @@ int hash(char *s, int n) {
       h ^= g;
     }
   }
-  return h & ((1 << 30) - 1);
+  /* a hash of zero would be taken for one not yet assigned */
+  h &= HASH_MASK;
+  return h != 0 ? h : 1;
+}
+
+
+unsigned long parseSize(char *s) {
+  unsigned long size;
+  char *end;
+
+  /* a number of bytes, optionally followed by K or M; */
+  /* answer 0 if the string is not a legal size */
+  size = strtoul(s, &end, 10);
+  if (end == s) {
+    return 0;
+  }
+  if (*end == 'K' || *end == 'k') {
+    size *= K;
+    end++;
+  } else
+  if (*end == 'M' || *end == 'm') {
+    size *= M;
+    end++;
+  }
+  if (*end != '\0') {
+    return 0;
+  }
+  return size;
 }
@@ -8,8 +8,10 @@
 
 
 void *allocate(unsigned int size);
+void *reallocate(void *p, unsigned int size);
 void release(void *p);
 int hash(char *s, int n);
+unsigned long parseSize(char *s);
 
 
 #endif /* _UTILS_H_ */
@@ -0,0 +1,324 @@
+/*
+ * relayout.c -- rewrite an MLS image file in a different memory layout
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "../sys/common.h"
+#include "../sys/utils.h"
+#include "../sys/machine.h"
+#include "../sys/objects.h"
+#include "../sys/memory.h"
+#include "../sys/ui.h"
+
+
+/*
+ * The image is loaded as usual, so that its objects are in the
+ * layout of this machine, and the permanent space is written out
+ * as it would have been written by a machine with the layout given
+ * on the command line. The machine loading the result must convert
+ * it, which is how the conversion in memory.c gets exercised.
+ */
+
+
+/* the header bits and the image header, as in memory.c */
+
+#define HAS_POINTERS		WORD_NSB
+#define HAS_WORDS		WORD_TSB
+#define REMEMBERED		(WORD_TSB >> 1)
+#define MARKED			(WORD_TSB >> 2)
+#define SIZE_MASK		((1 << 12) - 1)
+#define SIZE_OVERFLOW		SIZE_MASK
+
+#define NUM_KNOWN_PTRS	((offsetof(Machine, newContext) - \
+			  offsetof(Machine, nil)) / sizeof(ObjPtr) + 1)
+#define NUM_MACHINE_PTRS	(NUM_KNOWN_PTRS + 2)
+#define IMAGE_HEADER_SIZE	(10 * 4 + 6 * 8 + NUM_MACHINE_PTRS * 8)
+
+
+Machine machine;
+
+
+static Bool hostBigEndian;	/* byte order of this machine */
+static Bool bigEndian;		/* byte order of the new layout */
+static int ptrSize;		/* size of an object pointer in bytes */
+static int align;		/* alignment of objects in bytes */
+static Address newPermStart;	/* address of the first object */
+static Address *forward;	/* new address of every object */
+static Byte *objects;		/* the objects in the new layout */
+static Address objectsSize;	/* their size in bytes */
+
+
+void relocateCaches(void) {
+  /* no caches here, the image is only rewritten */
+}
+
+
+void completeContexts(void) {
+  /* no contexts run here, the image is only rewritten */
+}
+
+
+static ObjPtr *machinePtr(int i) {
+  if (i < NUM_KNOWN_PTRS) {
+    return &machine.nil + i;
+  }
+  return i == NUM_KNOWN_PTRS ? &machine.compilerMethod :
+                               &machine.compilerLiteral;
+}
+
+
+static Byte *putNumber(Byte *p, unsigned long long value,
+                       int size, Bool big) {
+  int i;
+
+  for (i = 0; i < size; i++) {
+    p[big ? size - 1 - i : i] = value & 0xFF;
+    value >>= 8;
+  }
+  return p + size;
+}
+
+
+static Word readHeaderWord(Address address) {
+  Word word;
+
+  memcpy(&word, memory + address, sizeof(Word));
+  return word;
+}
+
+
+static ObjPtr objectAt(Address address) {
+  /* skip the size in front of a large object */
+  if ((readHeaderWord(address + sizeof(Word)) & SIZE_MASK) ==
+      SIZE_OVERFLOW) {
+    return address + HEADER_SIZE;
+  }
+  return address;
+}
+
+
+static Address objectLength(ObjPtr object, int ps, int alignment) {
+  Address length;
+
+  length = getSize(object);
+  if (hasPtrs(object)) {
+    length *= ps;
+  } else
+  if (hasWords(object)) {
+    length *= sizeof(Word);
+  }
+  return (HEADER_SIZE + length + alignment - 1) &
+         ~(Address) (alignment - 1);
+}
+
+
+static Bool hasSizeInFront(ObjPtr object) {
+  return (readHeaderWord(object + sizeof(Word)) & SIZE_MASK) ==
+         SIZE_OVERFLOW;
+}
+
+
+static unsigned long long newPointer(ObjPtr object) {
+  unsigned long long mask;
+  long value;
+  int bits;
+
+  mask = ptrSize == 8 ? ~0ULL : (1ULL << (8 * ptrSize)) - 1;
+  if (object & IS_SHORTINT) {
+    value = getShortInteger(object);
+    bits = 8 * ptrSize - SHORTINT_SHIFT;
+    if (value < -(1L << (bits - 1)) || value >= (1L << (bits - 1))) {
+      sysError("short integer %ld does not fit into the new layout", value);
+    }
+    return (((unsigned long long) value << SHORTINT_SHIFT) |
+            IS_SHORTINT) & mask;
+  }
+  if (object == 0) {
+    return 0;
+  }
+  if (!isPermObject(object)) {
+    sysError("object 0x%lX is not in the permanent space", object);
+  }
+  return forward[(object - permStart) / ALIGN];
+}
+
+
+static void sizeObjects(void) {
+  Address address;
+  ObjPtr object;
+
+  /* first pass: compute the new address of every object */
+  forward = allocate((permEnd - permStart) / ALIGN * sizeof(Address));
+  objectsSize = 0;
+  for (address = permStart; address < permEnd;
+       address = object + objectLength(object, sizeof(ObjPtr), ALIGN)) {
+    object = objectAt(address);
+    if (hasSizeInFront(object)) {
+      objectsSize += HEADER_SIZE;
+    }
+    forward[(object - permStart) / ALIGN] = newPermStart + objectsSize;
+    objectsSize += objectLength(object, ptrSize, align);
+  }
+  if (ptrSize == 4 && newPermStart + objectsSize > 0xFFFFFFFFUL) {
+    sysError("objects do not fit below 4 GB in the new layout");
+  }
+}
+
+
+static void writeObjects(void) {
+  Address address;
+  ObjPtr object;
+  Byte *p;
+  Byte *body;
+  Word info;
+  int size;
+  int i;
+
+  /* second pass: write the objects in the new layout */
+  objects = allocate(objectsSize);
+  memset(objects, 0, objectsSize);
+  p = objects;
+  for (address = permStart; address < permEnd;
+       address = object + objectLength(object, sizeof(ObjPtr), ALIGN)) {
+    object = objectAt(address);
+    size = getSize(object);
+    info = readHeaderWord(object + sizeof(Word));
+    if (hasSizeInFront(object)) {
+      putNumber(p, size, sizeof(Word), bigEndian);
+      putNumber(p + sizeof(Word), SIZE_OVERFLOW, sizeof(Word), bigEndian);
+      p += HEADER_SIZE;
+    }
+    putNumber(p, newPointer(readHeaderWord(object)), sizeof(Word),
+              bigEndian);
+    putNumber(p + sizeof(Word), info & ~(REMEMBERED | MARKED),
+              sizeof(Word), bigEndian);
+    body = p + HEADER_SIZE;
+    if (info & HAS_POINTERS) {
+      for (i = 0; i < size; i++) {
+        putNumber(body + i * ptrSize, newPointer(getPtr(object, i)),
+                  ptrSize, bigEndian);
+      }
+    } else
+    if (info & HAS_WORDS) {
+      for (i = 0; i < size; i++) {
+        putNumber(body + i * sizeof(Word), getWord(object, i),
+                  sizeof(Word), bigEndian);
+      }
+    } else {
+      memcpy(body, memory + object + HEADER_SIZE, size);
+      /* floats are the only bytes which have a byte order */
+      if (getClass(object) == machine.Float &&
+          size == sizeof(double) &&
+          bigEndian != hostBigEndian) {
+        for (i = 0; i < size; i++) {
+          body[i] = *(Byte *) (memory + object + HEADER_SIZE +
+                               size - 1 - i);
+        }
+      }
+    }
+    p += objectLength(object, ptrSize, align);
+  }
+}
+
+
+static void writeImage(char *fileName) {
+  Byte header[IMAGE_HEADER_SIZE];
+  FILE *imageFile;
+  Byte *p;
+  int i;
+
+  /* the header is little-endian in every layout */
+  p = header;
+  p = putNumber(p, SIGNATURE_1, 4, false);
+  p = putNumber(p, SIGNATURE_2, 4, false);
+  p = putNumber(p, MAJOR_VNUM, 4, false);
+  p = putNumber(p, MINOR_VNUM, 4, false);
+  p = putNumber(p, IMAGE_FORMAT, 4, false);
+  p = putNumber(p, bigEndian, 4, false);
+  p = putNumber(p, ptrSize, 4, false);
+  p = putNumber(p, sizeof(Word), 4, false);
+  p = putNumber(p, align, 4, false);
+  p = putNumber(p, 8 * ptrSize - SHORTINT_SHIFT, 4, false);
+  p = putNumber(p, newPermStart, 8, false);
+  p = putNumber(p, IMAGE_HEADER_SIZE, 8, false);
+  p = putNumber(p, objectsSize, 8, false);
+  p = putNumber(p, 0, 8, false);
+  p = putNumber(p, machine.ip, 8, false);
+  p = putNumber(p, machine.sp, 8, false);
+  for (i = 0; i < NUM_MACHINE_PTRS; i++) {
+    p = putNumber(p, newPointer(*machinePtr(i)), 8, false);
+  }
+  imageFile = fopen(fileName, "wb");
+  if (imageFile == NULL) {
+    sysError("cannot open image file '%s' for write", fileName);
+  }
+  if (fwrite(header, 1, IMAGE_HEADER_SIZE, imageFile) !=
+        IMAGE_HEADER_SIZE ||
+      fwrite(objects, 1, objectsSize, imageFile) != objectsSize ||
+      fclose(imageFile) != 0) {
+    sysError("cannot write image file '%s'", fileName);
+  }
+}
+
+
+static void usage(char *myself) {
+  printf("Usage: %s [options] <image file> <new image file>\n", myself);
+  printf("Options:\n");
+  printf("  --big-endian           write words and pointers big-endian\n");
+  printf("  --little-endian        write words and pointers little-endian\n");
+  printf("  --ptr-size <bytes>     size of an object pointer, 4 or 8\n");
+  printf("  --align <bytes>        alignment of objects, a power of 2\n");
+  printf("  --perm-start <address> address of the first object\n");
+  exit(1);
+}
+
+
+int main(int argc, char *argv[]) {
+  Word one;
+  int i;
+
+  one = 1;
+  hostBigEndian = *(Byte *) &one == 0;
+  bigEndian = hostBigEndian;
+  ptrSize = sizeof(ObjPtr);
+  align = ALIGN;
+  newPermStart = 0;
+  for (i = 1; i < argc - 2; i++) {
+    if (strcmp(argv[i], "--big-endian") == 0) {
+      bigEndian = true;
+    } else
+    if (strcmp(argv[i], "--little-endian") == 0) {
+      bigEndian = false;
+    } else
+    if (strcmp(argv[i], "--ptr-size") == 0 && i < argc - 3) {
+      ptrSize = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--align") == 0 && i < argc - 3) {
+      align = atoi(argv[++i]);
+    } else
+    if (strcmp(argv[i], "--perm-start") == 0 && i < argc - 3) {
+      newPermStart = strtoul(argv[++i], NULL, 0);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (i != argc - 2 ||
+      (ptrSize != 4 && ptrSize != 8) ||
+      align < sizeof(Word) || (align & (align - 1)) != 0 ||
+      (newPermStart & (align - 1)) != 0) {
+    usage(argv[0]);
+  }
+  initMemory(argv[argc - 2]);
+  if (newPermStart == 0) {
+    newPermStart = permStart;
+  }
+  sizeObjects();
+  writeObjects();
+  writeImage(argv[argc - 1]);
+  return 0;
+}
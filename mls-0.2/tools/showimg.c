@@ -20,6 +20,16 @@
 Machine machine;
 
 
+void relocateCaches(void) {
+  /* no caches here, the image is only shown */
+}
+
+
+void completeContexts(void) {
+  /* no contexts run here, the image is only shown */
+}
+
+
 static struct {
   ObjPtr where;
   ObjPtr class;
@@ -223,7 +233,7 @@ static void showBrief(ObjPtr obj) {
 
   class = getClass(obj);
   if (class == machine.ShortInteger) {
-    printf("integer %d", getShortInteger(obj));
+    printf("integer %ld", getShortInteger(obj));
   } else {
     printf("object # %d ", find(obj));
     showClassInfo(class);
@@ -326,6 +336,14 @@ static void showRegisters(void) {
   showBrief(machine.Float);
   printf("\n");
 
+  printf("machine.LargePositiveInteger = ");
+  showBrief(machine.LargePositiveInteger);
+  printf("\n");
+
+  printf("machine.LargeNegativeInteger = ");
+  showBrief(machine.LargeNegativeInteger);
+  printf("\n");
+
   printf("machine.Character            = ");
   showBrief(machine.Character);
   printf("\n");